@@ -0,0 +1,78 @@
+// Cost of a full screen grid_line event, decoded and written to the grid,
+// with the single byte ascii cells widened as runs (Nvim::WidenAscii) and
+// with every cell going through the utf-8 path.
+//   grid_line_bench [rounds]
+#include "nvim_arena.h"
+#include "nvim_grid.h"
+#include "nvim_redraw.h"
+#include "redraw_batch.h"
+#include <chrono>
+#include <msgpackpp/msgpackpp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  Clock::duration elapsed;
+  std::vector<Nvim::Cell> cells;
+};
+
+static Result Run(bool ascii_runs, const msgpackpp::parser &grid_line,
+                  int rounds) {
+  Nvim::Grid grid;
+  grid.RowsCols(NvimTest::ROWS, NvimTest::COLS);
+  Nvim::Arena arena;
+
+  Result result = {};
+  uint64_t count = grid_line.count();
+  for (int i = 0; i < rounds; ++i) {
+    auto start = Clock::now();
+    // ["grid_line", [...], [...], ...]
+    auto args = grid_line.first_array_item().value;
+    for (uint64_t j = 1; j < count; ++j) {
+      args = args.next().value;
+      Nvim::WriteGridLine(&grid, Nvim::DecodeGridLine(args, arena, ascii_runs));
+    }
+    arena.Reset();
+    result.elapsed += Clock::now() - start;
+  }
+  for (int row = 0; row < grid.Rows(); ++row) {
+    auto cells = grid.RowCells(row);
+    result.cells.insert(result.cells.end(), cells, cells + grid.Cols());
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  auto batch = NvimTest::MakeRedrawBatch(0);
+  msgpackpp::parser params(batch.data(), static_cast<int>(batch.size()));
+  // the first grid_line draws every row
+  std::vector<msgpackpp::parser> grid_lines;
+  uint64_t event_count = params.count();
+  auto event = params.first_array_item().value;
+  for (uint64_t i = 0; i < event_count; ++i, event = event.next()) {
+    if (event[0].get_string() == "grid_line") {
+      grid_lines.push_back(event);
+    }
+  }
+
+  auto runs = Run(true, grid_lines[0], rounds);
+  auto cells = Run(false, grid_lines[0], rounds);
+  if (runs.cells != cells.cells) {
+    fprintf(stderr, "the two paths disagree\n");
+    return 1;
+  }
+
+  auto lines = static_cast<double>(NvimTest::ROWS) * rounds;
+  auto NsPerLine = [lines](Clock::duration elapsed) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / lines;
+  };
+  printf("%d lines of %d cells x %d rounds\n", NvimTest::ROWS, NvimTest::COLS,
+         rounds);
+  printf("ascii runs: %8.1f ns/line\n", NsPerLine(runs.elapsed));
+  printf("per cell:   %8.1f ns/line\n", NsPerLine(cells.elapsed));
+  return 0;
+}
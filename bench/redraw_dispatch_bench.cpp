@@ -0,0 +1,123 @@
+// Cost per redraw event of turning its name into an Nvim::RedrawEvent and
+// decoding it: the if/else chain NvimRedraw used before, against
+// Nvim::ToRedrawEvent and the decoder table.
+//   redraw_dispatch_bench [rounds]
+#include "nvim_grid.h"
+#include "nvim_redraw.h"
+#include "redraw_batch.h"
+#include <chrono>
+#include <msgpackpp/msgpackpp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// as NvimRedraw::DispatchEvent compared names, one literal after another
+static Nvim::RedrawEvent IfElseChain(std::string_view name) {
+  if (name == "option_set") {
+    return Nvim::RedrawEvent::OptionSet;
+  } else if (name == "grid_resize") {
+    return Nvim::RedrawEvent::GridResize;
+  } else if (name == "grid_clear") {
+    return Nvim::RedrawEvent::GridClear;
+  } else if (name == "default_colors_set") {
+    return Nvim::RedrawEvent::DefaultColorsSet;
+  } else if (name == "hl_attr_define") {
+    return Nvim::RedrawEvent::HlAttrDefine;
+  } else if (name == "grid_line") {
+    return Nvim::RedrawEvent::GridLine;
+  } else if (name == "grid_cursor_goto") {
+    return Nvim::RedrawEvent::GridCursorGoto;
+  } else if (name == "mode_info_set") {
+    return Nvim::RedrawEvent::ModeInfoSet;
+  } else if (name == "mode_change") {
+    return Nvim::RedrawEvent::ModeChange;
+  } else if (name == "busy_start") {
+    return Nvim::RedrawEvent::BusyStart;
+  } else if (name == "busy_stop") {
+    return Nvim::RedrawEvent::BusyStop;
+  } else if (name == "grid_scroll") {
+    return Nvim::RedrawEvent::GridScroll;
+  } else if (name == "flush") {
+    return Nvim::RedrawEvent::Flush;
+  } else {
+    return Nvim::RedrawEvent::Unknown;
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+static double NsPerEvent(Clock::duration elapsed, size_t events) {
+  return std::chrono::duration<double, std::nano>(elapsed).count() / events;
+}
+
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  auto batch = NvimTest::MakeRedrawBatch(100);
+  msgpackpp::parser params(batch.data(), static_cast<int>(batch.size()));
+  std::vector<msgpackpp::parser> events;
+  std::vector<std::string_view> names;
+  uint64_t event_count = params.count();
+  auto event = params.first_array_item().value;
+  for (uint64_t i = 0; i < event_count; ++i, event = event.next()) {
+    events.push_back(event);
+    names.push_back(event[0].get_string());
+  }
+
+  // names only
+  uint64_t sink = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    for (auto name : names) {
+      sink += static_cast<uint64_t>(IfElseChain(name));
+    }
+  }
+  auto chain = Clock::now() - start;
+  start = Clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    for (auto name : names) {
+      sink -= static_cast<uint64_t>(Nvim::ToRedrawEvent(name));
+    }
+  }
+  auto hash = Clock::now() - start;
+  if (sink != 0) {
+    fprintf(stderr, "the two lookups disagree\n");
+    return 1;
+  }
+
+  // names and decoding. the batch is applied between rounds, untimed
+  Nvim::Grid grid;
+  NvimTest::NullRenderer renderer;
+  NvimRedraw redraw;
+  Clock::duration chain_decode = {};
+  Clock::duration hash_decode = {};
+  for (int i = 0; i < rounds; ++i) {
+    start = Clock::now();
+    for (auto &e : events) {
+      auto type = IfElseChain(e[0].get_string());
+      uint64_t count = e.count();
+      auto args = e.first_array_item().value;
+      for (uint64_t j = 1; j < count; ++j) {
+        args = args.next().value;
+        redraw.DecodeArgs(type, args);
+      }
+    }
+    chain_decode += Clock::now() - start;
+    redraw.Apply(&grid, &renderer);
+
+    start = Clock::now();
+    for (auto &e : events) {
+      redraw.Decode(e);
+    }
+    hash_decode += Clock::now() - start;
+    redraw.Apply(&grid, &renderer);
+  }
+
+  auto count = events.size() * rounds;
+  printf("%zu events x %d rounds\n", events.size(), rounds);
+  printf("name lookup  if/else: %6.1f ns/event  ToRedrawEvent: %6.1f "
+         "ns/event\n",
+         NsPerEvent(chain, count), NsPerEvent(hash, count));
+  printf("with decode  if/else: %6.1f ns/event  ToRedrawEvent: %6.1f "
+         "ns/event\n",
+         NsPerEvent(chain_decode, count), NsPerEvent(hash_decode, count));
+  return 0;
+}
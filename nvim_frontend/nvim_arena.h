@@ -0,0 +1,75 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+namespace Nvim {
+
+// Bump allocator for data that lives until the end of one redraw batch.
+// Nothing is freed one by one. Reset at flush rewinds to the first block and
+// keeps every block, so after warm-up a batch does not touch the heap.
+class Arena {
+public:
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+private:
+  struct Block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+  std::vector<Block> _blocks;
+  size_t _block = 0;
+  size_t _pos = 0;
+  size_t _used = 0;
+  uint64_t _heap_allocations = 0;
+
+public:
+  Arena() {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    while (_block < _blocks.size()) {
+      auto &block = _blocks[_block];
+      auto base = reinterpret_cast<uintptr_t>(block.data.get());
+      auto aligned = (base + _pos + align - 1) & ~(uintptr_t)(align - 1);
+      if (aligned + size <= base + block.size) {
+        _pos = aligned + size - base;
+        _used += size;
+        return reinterpret_cast<void *>(aligned);
+      }
+      // does not fit. the rest of this block is wasted until Reset
+      ++_block;
+      _pos = 0;
+    }
+
+    auto block_size = std::max(BLOCK_SIZE, size + align);
+    _blocks.push_back({std::make_unique<uint8_t[]>(block_size), block_size});
+    ++_heap_allocations;
+    return Allocate(size, align);
+  }
+
+  // no destructor is run
+  template <typename T> T *Allocate(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value);
+    return static_cast<T *>(Allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  void Reset() {
+    _block = 0;
+    _pos = 0;
+    _used = 0;
+  }
+
+  // bytes handed out since the last Reset
+  size_t Used() const { return _used; }
+
+  // blocks taken from the heap so far. constant after warm-up
+  uint64_t HeapAllocations() const { return _heap_allocations; }
+};
+
+} // namespace Nvim
@@ -1,154 +1,165 @@
 #include "nvim_frontend.h"
 #include "nvim_grid.h"
+#include "nvim_io_pool.h"
+#include "nvim_msgpack.h"
 #include "nvim_pipe.h"
 #include "nvim_redraw.h"
+#include "nvim_rpc.h"
+#include "nvim_trace.h"
+#include "nvim_unicode.h"
 #include <asio.hpp>
+#include <assert.h>
 #include <msgpackpp/msgpackpp.h>
-#include <msgpackpp/rpc.h>
-#include <msgpackpp/windows_pipe_transport.h>
 #include <plog/Log.h>
-#include <thread>
+#include <string.h>
 #include <vector>
-
-static std::vector<char> ParseConfig(const msgpackpp::parser &config_node) {
-  auto p = config_node.get_string();
-  std::string path(p.begin(), p.end());
-  path += "\\init.vim";
-
-  HANDLE config_file =
-      CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
-                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-
-  std::vector<char> guifont_out;
-  if (config_file == INVALID_HANDLE_VALUE) {
-    return guifont_out;
-  }
-
-  LARGE_INTEGER file_size;
-  if (!GetFileSizeEx(config_file, &file_size)) {
-    CloseHandle(config_file);
-    return guifont_out;
-  }
-  std::vector<char> buffer(file_size.QuadPart);
-  DWORD bytes_read;
-  if (!ReadFile(config_file, buffer.data(), buffer.size(), &bytes_read, NULL)) {
-    CloseHandle(config_file);
-    return guifont_out;
+#include <wchar.h>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+struct Modifiers {
+  bool ctrl;
+  bool shift;
+  bool alt;
+
+  static Modifiers Get() {
+#ifdef _WIN32
+    return {
+        (GetKeyState(VK_CONTROL) & 0x80) != 0,
+        (GetKeyState(VK_SHIFT) & 0x80) != 0,
+        (GetKeyState(VK_MENU) & 0x80) != 0,
+    };
+#else
+    // no keyboard state without a window system
+    return {};
+#endif
   }
-  CloseHandle(config_file);
-
-  char *strtok_context;
-  char *line = strtok_s(buffer.data(), "\r\n", &strtok_context);
-  while (line) {
-    char *guifont = strstr(line, "set guifont=");
-    if (guifont) {
-      // Check if we're inside a comment
-      auto leading_count = guifont - line;
-      bool inside_comment = false;
-      for (int i = 0; i < leading_count; ++i) {
-        if (line[i] == '"') {
-          inside_comment = !inside_comment;
-        }
-      }
-      if (!inside_comment) {
-        guifont_out.clear();
-
-        int line_offset = (guifont - line + strlen("set guifont="));
-        int guifont_strlen = strlen(line) - line_offset;
-        int escapes = 0;
-        for (int i = 0; i < guifont_strlen; ++i) {
-          if (line[line_offset + i] == '\\' && i < (guifont_strlen - 1) &&
-              line[line_offset + i + 1] == ' ') {
-            guifont_out.push_back(' ');
-            ++i;
-            continue;
-          }
-          guifont_out.push_back(line[i + line_offset]);
-        }
-        guifont_out.push_back('\0');
-      }
-    }
-    line = strtok_s(NULL, "\r\n", &strtok_context);
-  }
-
-  return guifont_out;
-}
+};
 
-struct ThreadWork {
-  asio::io_context &_context;
-  asio::io_context::work _work;
-  std::thread _t;
-  ThreadWork(asio::io_context &context)
-      : _context(context), _work(context), _t([&context]() { context.run(); }) {
+// Hot notifications. The prefix is encoded at compile time, the arguments
+// into a stack buffer, so a key press does not touch the heap.
+static constexpr Nvim::MsgpackNotifyPrefix NVIM_INPUT("nvim_input", 1);
+static constexpr Nvim::MsgpackNotifyPrefix NVIM_INPUT_MOUSE("nvim_input_mouse",
+                                                            6);
+static constexpr Nvim::MsgpackNotifyPrefix
+    NVIM_UI_TRY_RESIZE("nvim_ui_try_resize", 2);
+
+struct NotifyBuffer {
+  static constexpr size_t CAPACITY = 256;
+  uint8_t data[CAPACITY];
+  uint8_t *end;
+
+  NotifyBuffer(const Nvim::MsgpackNotifyPrefix &prefix)
+      : end(data + prefix.size) {
+    memcpy(data, prefix.data, prefix.size);
   }
-  ~ThreadWork() {
-    _context.stop();
-    _t.join();
-  }
-  ThreadWork(const ThreadWork &) = delete;
-  ThreadWork &operator=(const ThreadWork &) = delete;
+  size_t Size() const { return end - data; }
+  // bytes left for arguments
+  size_t Free() const { return CAPACITY - Size(); }
 };
 
 class NvimFrontendImpl {
+  // shared with other frontends. see NvimIOPool
+  asio::io_context &_context;
   NvimPipe _pipe;
   Nvim::Grid _grid;
   NvimRedraw _redraw;
-  asio::io_context _context;
-  msgpackpp::rpc_base<msgpackpp::WindowsPipeTransport> _rpc;
+  NvimRpc _rpc;
+  NvimRenderer *_renderer = nullptr;
+  bool _initialized = false;
+  // nvim_get_api_info is not answered yet
+  bool _waiting_api_info = false;
 
 public:
+  NvimFrontendImpl(NvimIOPool *pool) : _context(pool->Context()) {}
+
   bool Launch(const wchar_t *command, const on_terminated_t &callback) {
-    return _pipe.Launch(command, callback);
+    if (!_pipe.Launch(_context, command, callback)) {
+      return false;
+    }
+    _rpc.attach(
+        NvimTransport(_context, _pipe.ReadHandle(), _pipe.WriteHandle()));
+    return true;
   }
 
-  std::string Initialize() {
-
-    _rpc.set_on_send([](auto data) {
-      msgpackpp::parser msg(data);
-      PLOGD << msg;
-    });
-
-    _rpc.attach(msgpackpp::WindowsPipeTransport(_context, _pipe.ReadHandle(),
-                                                _pipe.WriteHandle()));
-    ThreadWork sync(_context);
-
-    {
-      auto result = _rpc.request_async("nvim_get_api_info").get();
-      // TODO:
-      // mpack_node_t top_level_map =
-      //     mpack_node_array_at(result.params, 1);
-      // mpack_node_t version_map =
-      //     mpack_node_map_value_at(top_level_map, 0);
-      // int64_t api_level =
-      //     mpack_node_map_cstr(version_map, "api_level")
-      //         .data->value.i;
-      // assert(api_level > 6);
+  bool Connect(const wchar_t *address, const on_terminated_t &callback) {
+    native_pipe_t handle;
+    if (!NvimPipe::Connect(address, &handle)) {
+      return false;
     }
+    NvimTransport transport(_context, handle);
+    transport.set_on_closed(callback);
+    _rpc.attach(transport);
+    return true;
+  }
 
-    { _rpc.notify("nvim_set_var", "nvy", 1); }
+  // second call only waits for the answers. see NvimInstancePool
+  void BeginInitialize() {
+    if (_initialized) {
+      return;
+    }
+    _initialized = true;
+    _waiting_api_info = true;
 
-    std::string guifont;
+    // Everything goes out in one write and the responses come back
+    // together, so startup costs a single round trip.
     {
-      auto result = _rpc.request_async("nvim_eval", "stdpath('config')").get();
+      NvimRpc::Batch batch(_rpc);
+
+      _rpc.notify("nvim_set_var", "nvy", 1);
+
+      // An embedded nvim sources its config only after nvim_ui_attach, so
+      // this is empty there and option_set delivers the font. A --listen
+      // server answers with the font in use.
+      _rpc.request("nvim_get_option_value",
+                   [self = this](const msgpackpp::parser &error,
+                                 const msgpackpp::parser &result) {
+                     if (error.is_nil() && result.is_string()) {
+                       self->_redraw.SetGuiFont(self->_renderer,
+                                                result.get_string());
+                     }
+                   },
+                   "guifont", NvimEmptyMap{});
+
+      // answered after nvim_get_option_value
+      _rpc.request("nvim_get_api_info",
+                   [self = this](const msgpackpp::parser &error,
+                                 const msgpackpp::parser &result) {
+                     self->_waiting_api_info = false;
+                     if (!error.is_nil()) {
+                       return;
+                     }
+                     // [channel_id, {version: {api_level: ...}}]
+                     auto api_level = result[1]["version"]["api_level"];
+                     if (api_level.is_number()) {
+                       PLOGD << "(nvim) api_level: "
+                             << api_level.get_number<int>();
+                     }
+                   });
+    }
+  }
 
-      msgpackpp::parser msg(result);
-      auto f = ParseConfig(msg);
-      if (!f.empty()) {
-        guifont = std::string(f.data());
+  void Initialize() {
+    BeginInitialize();
+    while (_waiting_api_info) {
+      if (!_rpc.Process(true)) {
+        // nvim exited
+        break;
       }
     }
-    return guifont;
   }
 
-  void AttachUI(NvimRenderer *renderer, int rows, int cols) {
-    _rpc.add_proc("redraw",
-                  [self = this, renderer](
-                      const msgpackpp::parser &msg) -> std::vector<uint8_t> {
-                    self->_redraw.Dispatch(&self->_grid, renderer, msg);
-                    return {};
-                  });
+  const std::string &GuiFont() const { return _redraw.GuiFont(); }
 
-    ThreadWork sync(_context);
+  void AttachUI(NvimRenderer *renderer, int rows, int cols) {
+    _renderer = renderer;
+    // decoded as each argument tuple arrives, not when the whole batch is in
+    _rpc.add_stream_proc("redraw", [self = this, renderer](
+                                       const msgpackpp::parser &name,
+                                       const msgpackpp::parser &args) {
+      self->_redraw.DispatchArgs(&self->_grid, renderer, name, args);
+    });
 
     {
       // Send UI attach notification
@@ -156,102 +167,116 @@ public:
       args.pack_array(3);
       args << cols;
       args << rows;
-      args.pack_map(1);
+      args.pack_map(2);
       args << "ext_linegrid" << true;
+      args << "ext_multigrid" << true;
       auto msg = msgpackpp::make_rpc_notify_packed("nvim_ui_attach",
                                                    args.get_payload());
       _rpc.write_async(msg);
     }
   }
 
-  void Process() { _context.poll(); }
+  void Process() {
+    _rpc.Process();
+    if (_renderer) {
+      // backpressure mode draws here, once for everything received
+      _redraw.Render(&_grid, _renderer);
+    }
+  }
+  void SetRedrawBackpressure(bool enable) { _redraw.SetBackpressure(enable); }
+  Nvim::RedrawStats RedrawStats() const { return _redraw.Stats(); }
 
   void SendResize(int grid_rows, int grid_cols) {
-    auto msg =
-        msgpackpp::make_rpc_notify("nvim_ui_try_resize", grid_cols, grid_rows);
-    _rpc.write_async(msg);
+    NotifyBuffer msg(NVIM_UI_TRY_RESIZE);
+    msg.end = Nvim::MsgpackWriteInt(msg.end, grid_cols);
+    msg.end = Nvim::MsgpackWriteInt(msg.end, grid_rows);
+    _rpc.write_async(msg.data, msg.Size());
   }
 
   void SendMouseInput(Nvim::MouseButton button, Nvim::MouseAction action,
                       int mouse_row, int mouse_col) {
-    bool ctrl_down = (GetKeyState(VK_CONTROL) & 0x80) != 0;
-    bool shift_down = (GetKeyState(VK_SHIFT) & 0x80) != 0;
-    bool alt_down = (GetKeyState(VK_MENU) & 0x80) != 0;
+    auto modifiers = Modifiers::Get();
     constexpr int MAX_INPUT_STRING_SIZE = 64;
     char input_string[MAX_INPUT_STRING_SIZE];
     snprintf(input_string, MAX_INPUT_STRING_SIZE, "%s%s%s",
-             ctrl_down ? "C-" : "", shift_down ? "S-" : "",
-             alt_down ? "M-" : "");
-
-    auto msg = msgpackpp::make_rpc_notify(
-        "nvim_input_mouse", GetMouseBotton(button), GetMouseAction(action),
-        (const char *)input_string, 0, mouse_row, mouse_col);
-    _rpc.write_async(msg);
+             modifiers.ctrl ? "C-" : "", modifiers.shift ? "S-" : "",
+             modifiers.alt ? "M-" : "");
+
+    auto button_name = GetMouseBotton(button);
+    auto action_name = GetMouseAction(action);
+    NotifyBuffer msg(NVIM_INPUT_MOUSE);
+    msg.end = Nvim::MsgpackWriteStr(msg.end, button_name ? button_name : "");
+    msg.end = Nvim::MsgpackWriteStr(msg.end, action_name ? action_name : "");
+    msg.end = Nvim::MsgpackWriteStr(msg.end, input_string);
+    // the window grid under the mouse and the cell within it
+    auto [grid, row, col] = _redraw.HitTest(&_grid, mouse_row, mouse_col);
+    msg.end = Nvim::MsgpackWriteInt(msg.end, grid);
+    msg.end = Nvim::MsgpackWriteInt(msg.end, row);
+    msg.end = Nvim::MsgpackWriteInt(msg.end, col);
+    _rpc.write_async(msg.data, msg.Size());
   }
 
   void SendChar(wchar_t input_char) {
     // If the space is simply a regular space,
     // simply send the modified input
-    if (input_char == VK_SPACE) {
+    if (input_char == L' ') {
       NvimSendModifiedInput("Space", true);
       return;
     }
 
     char utf8_encoded[64]{};
-    if (!WideCharToMultiByte(CP_UTF8, 0, &input_char, 1, 0, 0, NULL, NULL)) {
+    if (!Nvim::Utf16ToUtf8(&input_char, 1, utf8_encoded,
+                           sizeof(utf8_encoded) - 1)) {
       return;
     }
-    WideCharToMultiByte(CP_UTF8, 0, &input_char, 1, utf8_encoded, 64, NULL,
-                        NULL);
 
-    auto msg =
-        msgpackpp::make_rpc_notify("nvim_input", (const char *)utf8_encoded);
-    _rpc.write_async(msg);
+    SendInput(utf8_encoded);
   }
 
   void SendSysChar(wchar_t input_char) {
     char utf8_encoded[64]{};
-    if (!WideCharToMultiByte(CP_UTF8, 0, &input_char, 1, 0, 0, NULL, NULL)) {
+    if (!Nvim::Utf16ToUtf8(&input_char, 1, utf8_encoded,
+                           sizeof(utf8_encoded) - 1)) {
       return;
     }
-    WideCharToMultiByte(CP_UTF8, 0, &input_char, 1, utf8_encoded, 64, NULL,
-                        NULL);
 
     NvimSendModifiedInput(utf8_encoded, true);
   }
 
   void NvimSendModifiedInput(const char *input, bool virtual_key) {
-    bool shift_down = (GetKeyState(VK_SHIFT) & 0x80) != 0;
-    bool ctrl_down = (GetKeyState(VK_CONTROL) & 0x80) != 0;
-    bool alt_down = (GetKeyState(VK_MENU) & 0x80) != 0;
+    auto modifiers = Modifiers::Get();
 
     constexpr int MAX_INPUT_STRING_SIZE = 64;
     char input_string[MAX_INPUT_STRING_SIZE];
 
     snprintf(input_string, MAX_INPUT_STRING_SIZE, "<%s%s%s%s>",
-             ctrl_down ? "C-" : "", shift_down ? "S-" : "",
-             alt_down ? "M-" : "", input);
+             modifiers.ctrl ? "C-" : "", modifiers.shift ? "S-" : "",
+             modifiers.alt ? "M-" : "", input);
 
-    auto msg =
-        msgpackpp::make_rpc_notify("nvim_input", (const char *)input_string);
-    _rpc.write_async(msg);
+    SendInput(input_string);
   }
 
   void SendInput(std::string_view input_chars) {
-    auto msg = msgpackpp::make_rpc_notify("nvim_input", input_chars);
-    _rpc.write_async(msg);
+    NotifyBuffer msg(NVIM_INPUT);
+    // str header is at most 5 bytes
+    if (input_chars.size() + 5 > msg.Free()) {
+      // a long paste
+      _rpc.notify("nvim_input", input_chars);
+      return;
+    }
+    msg.end = Nvim::MsgpackWriteStr(msg.end, input_chars);
+    _rpc.write_async(msg.data, msg.Size());
   }
 
   void OpenFile(const wchar_t *file_name) {
-    char utf8_encoded[MAX_PATH]{};
-    WideCharToMultiByte(CP_UTF8, 0, file_name, -1, utf8_encoded, MAX_PATH, NULL,
-                        NULL);
-
-    char file_command[MAX_PATH + 2] = {};
-    strcpy_s(file_command, MAX_PATH, "e ");
-    strcat_s(file_command, MAX_PATH - 3, utf8_encoded);
-
-    _rpc.request_async("nvim_command", (const char *)file_command);
+    std::string file_command = "e ";
+    auto offset = file_command.size();
+    file_command.resize(offset + wcslen(file_name) * 4);
+    file_command.resize(offset + Nvim::Utf16ToUtf8(file_name, -1,
+                                                   &file_command[offset],
+                                                   file_command.size() - offset));
+
+    _rpc.request_async("nvim_command", file_command.c_str());
   }
 
   Nvim::GridSize GridSize() const { return _grid.Size(); }
@@ -260,14 +285,20 @@ public:
   const Nvim::HighlightAttribute *DefaultAttribute() const {
     return &_grid.hl(0);
   }
+  Nvim::WriteStats WriteStats() const { return _rpc.write_stats(); }
 };
 
-NvimFrontend::NvimFrontend() : _impl(new NvimFrontendImpl) {}
+NvimFrontend::NvimFrontend(NvimIOPool *pool)
+    : _impl(new NvimFrontendImpl(pool ? pool : &NvimIOPool::Default())) {}
 NvimFrontend::~NvimFrontend() { delete _impl; }
 bool NvimFrontend::Launch(const wchar_t *command,
                           const on_terminated_t &callback) {
   return _impl->Launch(command, callback);
 }
+bool NvimFrontend::Connect(const wchar_t *address,
+                           const on_terminated_t &callback) {
+  return _impl->Connect(address, callback);
+}
 void NvimFrontend::AttachUI(NvimRenderer *renderer, int rows, int cols) {
   _impl->AttachUI(renderer, rows, cols);
 }
@@ -275,10 +306,14 @@ void NvimFrontend::ResizeGrid(int rows, int cols) {
   _impl->SendResize(rows, cols);
 }
 
-std::tuple<std::string_view, float> NvimFrontend::Initialize() {
-  auto guifont = _impl->Initialize();
-  return NvimRedraw::ParseGUIFont(guifont);
+std::tuple<std::string_view, float>
+NvimFrontend::Initialize(std::string_view cached_guifont) {
+  _impl->Initialize();
+  auto &guifont = _impl->GuiFont();
+  return NvimRedraw::ParseGUIFont(guifont.empty() ? cached_guifont : guifont);
 }
+void NvimFrontend::BeginInitialize() { _impl->BeginInitialize(); }
+std::string_view NvimFrontend::GuiFont() const { return _impl->GuiFont(); }
 void NvimFrontend::Process() { _impl->Process(); }
 void NvimFrontend::Input(const Nvim::InputEvent &e) {
   switch (e.type) {
@@ -311,3 +346,18 @@ const Nvim::HighlightAttribute *NvimFrontend::DefaultAttribute() const {
 Nvim::GridSize NvimFrontend::GridSize() const { return _impl->GridSize(); }
 bool NvimFrontend::Sizing() const { return _impl->Sizing(); }
 void NvimFrontend::SetSizing() { return _impl->SetSizing(); }
+Nvim::WriteStats NvimFrontend::WriteStats() const {
+  return _impl->WriteStats();
+}
+void NvimFrontend::SetRedrawBackpressure(bool enable) {
+  _impl->SetRedrawBackpressure(enable);
+}
+Nvim::RedrawStats NvimFrontend::RedrawStats() const {
+  return _impl->RedrawStats();
+}
+void NvimFrontend::EnableTrace(bool enable) {
+  Nvim::TraceRing::Instance().Enable(enable);
+}
+size_t NvimFrontend::DumpTrace(FILE *fp) {
+  return Nvim::TraceRing::Instance().Dump(fp);
+}
@@ -1,7 +1,9 @@
 #pragma once
 #include "nvim_grid.h"
 #include "nvim_input.h"
+#include "nvim_stats.h"
 #include <functional>
+#include <stdio.h>
 #include <string>
 
 namespace msgpackpp {
@@ -12,17 +14,36 @@ class NvimFrontend {
   class NvimFrontendImpl *_impl = nullptr;
 
 public:
-  NvimFrontend();
+  // pool: io threads shared with other frontends. nullptr => default pool
+  NvimFrontend(class NvimIOPool *pool = nullptr);
   ~NvimFrontend();
   // nvim --embed
+  // callback is invoked on an io thread
   bool Launch(const wchar_t *command, const on_terminated_t &callback);
-  // return guifont
-  std::tuple<std::string_view, float> Initialize();
+  // attach to a running `nvim --listen address` instead of Launch.
+  // callback is invoked on an io thread when the server goes away
+  bool Connect(const wchar_t *address, const on_terminated_t &callback);
+  // Return the font to start the renderer with: the guifont nvim reported
+  // if already known (attached to a running server), else cached_guifont.
+  // init.vim is not read. The real font arrives later through option_set.
+  // blocks for one round trip, the second call returns immediately
+  std::tuple<std::string_view, float>
+  Initialize(std::string_view cached_guifont = {});
+  // Send what Initialize sends and return without waiting. Initialize then
+  // only processes the answers, which are likely already received
+  void BeginInitialize();
+  // latest guifont reported by nvim. save it for the next Initialize
+  std::string_view GuiFont() const;
 
   void AttachUI(class NvimRenderer *renderer, int rows, int cols);
   void ResizeGrid(int rows, int cols);
 
+  // call once per display frame
   void Process();
+  // Apply every redraw event but draw only the newest state once per
+  // Process, skipping intermediate flushes. For floods such as a :terminal
+  // dumping a log.
+  void SetRedrawBackpressure(bool enable);
   void Input(const Nvim::InputEvent &e);
   void Mouse(const Nvim::MouseEvent &e);
   void OpenFile(const wchar_t *file);
@@ -32,4 +53,13 @@ public:
   void SetSizing();
 
   const Nvim::HighlightAttribute *DefaultAttribute() const;
+
+  Nvim::WriteStats WriteStats() const;
+  Nvim::RedrawStats RedrawStats() const;
+
+  // Trace ring shared by every frontend. Records nothing unless built with
+  // -DNVIM_FRONTEND_TRACE=ON. see nvim_trace.h
+  static void EnableTrace(bool enable);
+  // Write the newest records for tools/nvim_trace_format. Returns the count
+  static size_t DumpTrace(FILE *fp);
 };
@@ -1,15 +1,15 @@
 #include "nvim_grid.h"
-
-constexpr int MAX_HIGHLIGHT_ATTRIBS = 0xFFFF;
+#include "nvim_unicode.h"
+#include <algorithm>
+#include <numeric>
+#include <string.h>
 
 namespace Nvim {
 
-Grid::Grid() {
-  _hl.resize(MAX_HIGHLIGHT_ATTRIBS);
-  for (auto &hl : _hl) {
-    hl._default = &_hl[0];
-  }
-}
+Grid::Grid() : _shared(std::make_shared<GridShared>()) {}
+
+Grid::Grid(int id, const Grid &global)
+    : _id(id), _placement{0, 0, 0, false}, _shared(global._shared) {}
 
 Grid::~Grid() {}
 
@@ -18,15 +18,40 @@ bool Grid::RowsCols(int rows, int cols) {
   if (size == _size) {
     return false;
   }
-  _size = size;
 
-  auto count = Count();
-  _grid_chars.resize(count);
-  // Initialize all grid character to a space. An empty
-  // grid cell is equivalent to a space in a text layout
-  std::fill(_grid_chars.begin(), _grid_chars.end(), L' ');
+  // Until nvim redraws, the frame shows the old content cut to the new size
+  // instead of a blank grid. Clusters are kept, the cells may refer to them
+  auto count = static_cast<size_t>(rows) * cols;
+  _resize_cells.resize(count);
+  _resize_properties.resize(count);
+  int keep_rows = std::min(rows, _size.rows);
+  int keep_cols = std::min(cols, _size.cols);
+  for (int row = 0; row < rows; ++row) {
+    auto cells = &_resize_cells[static_cast<size_t>(row) * cols];
+    auto props = &_resize_properties[static_cast<size_t>(row) * cols];
+    int kept = 0;
+    if (row < keep_rows) {
+      kept = keep_cols;
+      memcpy(cells, RowCells(row), kept * sizeof(Cell));
+      memcpy(props, RowProps(row), kept * sizeof(CellProperty));
+      if (kept > 0 && kept < _size.cols && props[kept - 1].is_wide_char) {
+        // the right half was cut off
+        cells[kept - 1] = U' ';
+        props[kept - 1].is_wide_char = false;
+      }
+    }
+    // An empty grid cell is equivalent to a space in a text layout
+    std::fill(cells + kept, cells + cols, U' ');
+    std::fill(props + kept, props + cols, CellProperty{});
+  }
+  _grid_cells.swap(_resize_cells);
+  _grid_cell_properties.swap(_resize_properties);
+  _size = size;
 
-  _grid_cell_properties.resize(count);
+  _row_index.resize(rows);
+  std::iota(_row_index.begin(), _row_index.end(), 0);
+  _dirty_rows.resize((rows + 63) / 64);
+  MarkAllDirty();
 
   for (auto &callback : _sizeCallbacks) {
     callback(size);
@@ -35,22 +60,177 @@ bool Grid::RowsCols(int rows, int cols) {
 }
 
 void Grid::LineCopy(int left, int right, int src_row, int dst_row) {
-  memcpy(&this->_grid_chars[dst_row * this->_size.cols + left],
-         &this->_grid_chars[src_row * this->_size.cols + left],
-         (right - left) * sizeof(wchar_t));
+  memcpy(RowCells(dst_row) + left, RowCells(src_row) + left,
+         (right - left) * sizeof(Cell));
 
-  memcpy(&this->_grid_cell_properties[dst_row * this->_size.cols + left],
-         &this->_grid_cell_properties[src_row * this->_size.cols + left],
+  memcpy(RowProps(dst_row) + left, RowProps(src_row) + left,
          (right - left) * sizeof(CellProperty));
 }
 
+bool Grid::Scroll(int top, int bottom, int left, int right, int rows) {
+  // a window grid is 0x0 until its grid_resize
+  if (rows == 0 || top < 0 || top >= bottom || bottom > _size.rows ||
+      left < 0 || left >= right || right > _size.cols) {
+    return false;
+  }
+
+  if (left == 0 && right == _size.cols) {
+    // whole rows. rotate the index, no cell is moved
+    auto first = _row_index.begin() + top;
+    auto last = _row_index.begin() + bottom;
+    int count = bottom - top;
+    int shift = rows > 0 ? rows % count : count - (-rows % count);
+    std::rotate(first, first + shift, last);
+    return true;
+  }
+
+  // partial width. copy in the direction that does not overwrite the source
+  if (rows > 0) {
+    for (int dst = top; dst + rows < bottom; ++dst) {
+      LineCopy(left, right, dst + rows, dst);
+    }
+  } else {
+    for (int dst = bottom - 1; dst + rows >= top; --dst) {
+      LineCopy(left, right, dst + rows, dst);
+    }
+  }
+  return true;
+}
+
 void Grid::Clear() {
   // Initialize all grid character to a space.
-  for (int i = 0; i < this->_size.cols * this->_size.rows; ++i) {
-    this->_grid_chars[i] = L' ';
-  }
+  std::fill(_grid_cells.begin(), _grid_cells.end(), U' ');
+  _clusters.clear();
+  _cluster_ids.clear();
+  _cluster_limit = MIN_CLUSTER_LIMIT;
   memset(this->_grid_cell_properties.data(), 0,
          this->_size.cols * this->_size.rows * sizeof(CellProperty));
 }
 
+Cell Grid::MakeCell(const uint32_t *codepoints, size_t count) {
+  if (count == 0) {
+    return U' ';
+  }
+  if (count == 1) {
+    return codepoints[0];
+  }
+  std::u32string key(reinterpret_cast<const char32_t *>(codepoints), count);
+  auto found = _cluster_ids.find(key);
+  if (found != _cluster_ids.end()) {
+    return CELL_CLUSTER | found->second;
+  }
+  if (_clusters.size() >= _cluster_limit) {
+    // cells overwritten by grid_line or cut by a resize leave theirs behind
+    CompactClusters();
+  }
+  auto id = static_cast<uint32_t>(_clusters.size());
+  _clusters.push_back(key);
+  _cluster_ids.emplace(std::move(key), id);
+  return CELL_CLUSTER | id;
+}
+
+void Grid::CompactClusters() {
+  constexpr uint32_t UNUSED = ~0u;
+  std::vector<uint32_t> remap(_clusters.size(), UNUSED);
+  std::vector<std::u32string> live;
+  // every storage row. the row index only orders them
+  for (auto &cell : _grid_cells) {
+    if (!(cell & CELL_CLUSTER)) {
+      continue;
+    }
+    auto &id = remap[cell & ~CELL_CLUSTER];
+    if (id == UNUSED) {
+      id = static_cast<uint32_t>(live.size());
+      live.push_back(std::move(_clusters[cell & ~CELL_CLUSTER]));
+    }
+    cell = CELL_CLUSTER | id;
+  }
+  _clusters.swap(live);
+  _cluster_ids.clear();
+  for (uint32_t id = 0; id < _clusters.size(); ++id) {
+    _cluster_ids.emplace(_clusters[id], id);
+  }
+  _cluster_limit = std::max(MIN_CLUSTER_LIMIT, 2 * _clusters.size());
+}
+
+void Grid::AppendUtf16(Cell cell, std::wstring *dst) const {
+  wchar_t buf[2];
+  if (cell & CELL_CLUSTER) {
+    for (auto cp : Cluster(cell)) {
+      dst->append(buf, CodepointToUtf16(cp, buf));
+    }
+  } else if (cell) {
+    dst->append(buf, CodepointToUtf16(cell, buf));
+  }
+}
+
+void Grid::SetHighlightAttribute(size_t index, const HighlightAttribute &hl) {
+  if (index == 0) {
+    SetDefaultColors(hl.foreground, hl.background, hl.special);
+    return;
+  }
+  auto &shared = *_shared;
+  if (index >= shared.hl.size()) {
+    shared.hl.resize(index + 1, shared.undefined_hl);
+  }
+  auto &entry = shared.hl[index];
+  entry = hl;
+  entry.resolved = entry.Resolve(shared.default_hl);
+  entry.version = ++shared.hl_version;
+}
+
+void Grid::SetDefaultColors(uint32_t foreground, uint32_t background,
+                            uint32_t special) {
+  auto &shared = *_shared;
+  shared.default_hl.foreground = foreground;
+  shared.default_hl.background = background;
+  shared.default_hl.special = special;
+  shared.default_hl.flags = 0;
+
+  auto version = ++shared.hl_version;
+  shared.default_hl.resolved = shared.default_hl.Resolve(shared.default_hl);
+  shared.default_hl.version = version;
+  shared.undefined_hl.resolved = shared.undefined_hl.Resolve(shared.default_hl);
+  shared.undefined_hl.version = version;
+  for (auto &entry : shared.hl) {
+    entry.resolved = entry.Resolve(shared.default_hl);
+    entry.version = version;
+  }
+}
+
+void Grid::MarkAllDirty() {
+  std::fill(_dirty_rows.begin(), _dirty_rows.end(), 0);
+  for (int row = 0; row < _size.rows; ++row) {
+    MarkDirty(row);
+  }
+}
+
+void Grid::ScrollDirty(int top, int bottom, bool full_width, int rows) {
+  top = std::max(top, 0);
+  bottom = std::min(bottom, _size.rows);
+  auto move = [this, bottom, top, full_width, rows](int row) {
+    int src = row + rows;
+    bool dirty = src >= top && src < bottom && IsDirty(src);
+    if (!full_width && IsDirty(row)) {
+      dirty = true;
+    }
+    auto bit = 1ull << (row % 64);
+    if (dirty) {
+      _dirty_rows[row / 64] |= bit;
+    } else {
+      _dirty_rows[row / 64] &= ~bit;
+    }
+  };
+  // read each source before it is overwritten
+  if (rows > 0) {
+    for (int row = top; row < bottom; ++row) {
+      move(row);
+    }
+  } else {
+    for (int row = bottom - 1; row >= top; --row) {
+      move(row);
+    }
+  }
+}
+
 } // namespace Nvim
\ No newline at end of file
@@ -1,7 +1,10 @@
 #pragma once
 #include <functional>
-#include <list>
+#include <memory>
 #include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace Nvim {
@@ -44,38 +47,56 @@ enum HighlightAttributeFlags : uint16_t {
 
 constexpr uint32_t DEFAULT_COLOR = 0x46464646;
 
+// colors to draw with. reverse and DEFAULT_COLOR already applied
+struct ResolvedColors {
+  uint32_t foreground;
+  uint32_t background;
+  uint32_t special;
+};
+
+// DEFAULT_COLOR fields take the color of the default attribute (id 0).
+// It is passed in rather than pointed to by every entry
 struct HighlightAttribute {
   uint32_t foreground;
   uint32_t background;
   uint32_t special;
   uint16_t flags;
-  HighlightAttribute *_default;
+  // kept up to date by Grid. renderers draw with these
+  ResolvedColors resolved;
+  // Grid::HighlightVersion() when resolved last changed
+  uint64_t version;
 
-  uint32_t CreateForegroundColor() const {
+  uint32_t CreateForegroundColor(const HighlightAttribute &default_hl) const {
     if (this->flags & HL_ATTRIB_REVERSE) {
-      return this->background == DEFAULT_COLOR ? this->_default->background
+      return this->background == DEFAULT_COLOR ? default_hl.background
                                                : this->background;
     } else {
-      return this->foreground == DEFAULT_COLOR ? this->_default->foreground
+      return this->foreground == DEFAULT_COLOR ? default_hl.foreground
                                                : this->foreground;
     }
   }
 
-  uint32_t CreateBackgroundColor() const {
+  uint32_t CreateBackgroundColor(const HighlightAttribute &default_hl) const {
     if (this->flags & HL_ATTRIB_REVERSE) {
-      return this->foreground == DEFAULT_COLOR ? this->_default->foreground
+      return this->foreground == DEFAULT_COLOR ? default_hl.foreground
                                                : this->foreground;
     } else {
-      return this->background == DEFAULT_COLOR ? this->_default->background
+      return this->background == DEFAULT_COLOR ? default_hl.background
                                                : this->background;
     }
   }
 
-  uint32_t CreateSpecialColor() const {
-    return this->special == DEFAULT_COLOR ? this->_default->special
-                                          : this->special;
+  uint32_t CreateSpecialColor(const HighlightAttribute &default_hl) const {
+    return this->special == DEFAULT_COLOR ? default_hl.special : this->special;
+  }
+
+  ResolvedColors Resolve(const HighlightAttribute &default_hl) const {
+    return {CreateForegroundColor(default_hl), CreateBackgroundColor(default_hl),
+            CreateSpecialColor(default_hl)};
   }
 };
+// CellProperty::hl_attrib_id is 16bit
+constexpr size_t MAX_HIGHLIGHT_ATTRIBS = 0xFFFF;
 
 using HighlightAttributes = std::vector<HighlightAttribute>;
 
@@ -87,42 +108,157 @@ struct CursorModeInfo {
 };
 
 struct Cursor {
-  CursorModeInfo *mode_info;
   int row;
   int col;
 };
 
+// Per ui, not per grid: highlights and cursor modes. Shared by the global
+// grid and the window grids of ext_multigrid
+struct GridShared {
+  CursorModeInfo cursor_mode_infos[MAX_CURSOR_MODE_INFOS] = {};
+  CursorModeInfo *cursor_mode_info = nullptr;
+  // id 0. apart from hl so its address stays put. see DefaultAttribute
+  HighlightAttribute default_hl = {};
+  // id -> attribute. grows to the largest id nvim has defined
+  HighlightAttributes hl;
+  // ids not defined yet. all default colors
+  HighlightAttribute undefined_hl = {DEFAULT_COLOR, DEFAULT_COLOR,
+                                     DEFAULT_COLOR, 0, {}, 0};
+  uint64_t hl_version = 0;
+};
+
+// ext_multigrid. where a grid is composited, in cells of the global grid
+struct GridPlacement {
+  int row;
+  int col;
+  // composited in ascending order. windows 0, floats their zindex
+  int zindex;
+  bool visible;
+};
+
+// the global grid without ext_multigrid
+constexpr int GLOBAL_GRID = 1;
+
+// A codepoint, or CELL_CLUSTER | index of a cluster interned by the grid
+// (several codepoints drawn as one glyph, e.g. combining marks).
+// 0 is the right half of a wide char
+using Cell = uint32_t;
+constexpr Cell CELL_CLUSTER = 0x80000000;
+constexpr size_t MAX_CLUSTER_CODEPOINTS = 32;
+// the intern table is compacted when it reaches this, or twice the clusters
+// still in use after the last compaction
+constexpr size_t MIN_CLUSTER_LIMIT = 1024;
+
 struct CellProperty {
   uint16_t hl_attrib_id;
   bool is_wide_char;
 };
 
 class Grid {
+  int _id = GLOBAL_GRID;
+  GridPlacement _placement = {0, 0, 0, true};
+  std::shared_ptr<GridShared> _shared;
   GridSize _size = {};
-  std::vector<wchar_t> _grid_chars;
+  std::vector<Cell> _grid_cells;
   std::vector<CellProperty> _grid_cell_properties;
-  CursorModeInfo _cursor_mode_infos[MAX_CURSOR_MODE_INFOS] = {};
+  // row -> storage row. a full width scroll rotates this instead of the cells
+  std::vector<int> _row_index;
+  // RowsCols copies the kept cells into these and swaps. capacity is kept,
+  // so a resize storm allocates only when the grid grows past its largest
+  std::vector<Cell> _resize_cells;
+  std::vector<CellProperty> _resize_properties;
+  // referenced by cells. dropped when every cell is reset, compacted when
+  // it reaches _cluster_limit
+  std::vector<std::u32string> _clusters;
+  std::unordered_map<std::u32string, uint32_t> _cluster_ids;
+  size_t _cluster_limit = MIN_CLUSTER_LIMIT;
   Cursor _cursor = {0};
-  std::list<GridSizeChanged> _sizeCallbacks;
-  HighlightAttributes _hl;
+  std::vector<GridSizeChanged> _sizeCallbacks;
+  // one bit per row changed since the last render
+  std::vector<uint64_t> _dirty_rows;
 
 public:
+  // the global grid
   Grid();
+  // a window grid. shares highlights and cursor modes with global
+  Grid(int id, const Grid &global);
   ~Grid();
   Grid(const Grid &) = delete;
   Grid &operator=(const Grid &) = delete;
+  int Id() const { return _id; }
+  const GridPlacement &Placement() const { return _placement; }
+  void SetPlacement(const GridPlacement &placement) { _placement = placement; }
   int Rows() const { return _size.rows; }
   int Cols() const { return _size.cols; }
   GridSize Size() const { return _size; }
   int Count() const { return _size.cols * _size.rows; }
-  wchar_t *Chars() { return _grid_chars.data(); }
-  const wchar_t *Chars() const { return _grid_chars.data(); }
-  CellProperty *Props() { return _grid_cell_properties.data(); }
-  const CellProperty *Props() const { return _grid_cell_properties.data(); }
+  // Rows are not contiguous. Use the row pointers, cols cells each
+  Cell *RowCells(int row) { return &_grid_cells[_row_index[row] * _size.cols]; }
+  const Cell *RowCells(int row) const {
+    return &_grid_cells[_row_index[row] * _size.cols];
+  }
+  CellProperty *RowProps(int row) {
+    return &_grid_cell_properties[_row_index[row] * _size.cols];
+  }
+  const CellProperty *RowProps(int row) const {
+    return &_grid_cell_properties[_row_index[row] * _size.cols];
+  }
+  // grid_resize. the cells that still fit keep their row and col, the new
+  // ones are blank. every row is dirty
   bool RowsCols(int rows, int cols);
   void LineCopy(int left, int right, int src_row, int dst_row);
+  // grid_scroll. rows > 0 moves the region [top, bottom) up.
+  // the exposed rows keep stale cells until nvim redraws them.
+  // false if nothing moved: no rows, or a region outside the grid
+  bool Scroll(int top, int bottom, int left, int right, int rows);
   void Clear();
 
+  // the cell for these codepoints. more than one is interned as a cluster
+  Cell MakeCell(const uint32_t *codepoints, size_t count);
+  std::u32string_view Cluster(Cell cell) const {
+    return _clusters[cell & ~CELL_CLUSTER];
+  }
+  size_t ClusterCount() const { return _clusters.size(); }
+  // drop the clusters no cell refers to and renumber the rest
+  void CompactClusters();
+  // append the cell as utf16 (see nvim_unicode.h). the right half of a wide
+  // char appends nothing
+  void AppendUtf16(Cell cell, std::wstring *dst) const;
+
+  // Rows are marked while a batch is applied and drawn once at flush.
+  void MarkDirty(int row) {
+    if (row >= 0 && row < _size.rows) {
+      _dirty_rows[row / 64] |= 1ull << (row % 64);
+    }
+  }
+  void MarkAllDirty();
+  bool IsDirty(int row) const {
+    return row >= 0 && row < _size.rows &&
+           (_dirty_rows[row / 64] & (1ull << (row % 64)));
+  }
+  // a grid_scroll the renderer moves as pixels. marks move with their rows.
+  // a partial width row is also still dirty if it was before
+  void ScrollDirty(int top, int bottom, bool full_width, int rows);
+  // calls f(row) for each dirty row in order and clears the marks.
+  // returns the count
+  template <typename F> int TakeDirtyRows(const F &f) {
+    int count = 0;
+    for (size_t i = 0; i < _dirty_rows.size(); ++i) {
+      auto bits = _dirty_rows[i];
+      if (!bits) {
+        continue;
+      }
+      _dirty_rows[i] = 0;
+      for (int bit = 0; bit < 64; ++bit) {
+        if (bits & (1ull << bit)) {
+          f(static_cast<int>(i * 64 + bit));
+          ++count;
+        }
+      }
+    }
+    return count;
+  }
+
   void SetCursor(int row, int col) {
     _cursor.row = row;
     _cursor.col = col;
@@ -130,28 +266,40 @@ public:
   int CursorRow() const { return _cursor.row; }
   int CursorCol() const { return _cursor.col; }
   CursorShape GetCursorShape() const {
-    if (_cursor.mode_info) {
-      return _cursor.mode_info->shape;
+    if (_shared->cursor_mode_info) {
+      return _shared->cursor_mode_info->shape;
     } else {
       return CursorShape::None;
     }
   }
   void SetCursorShape(int i, CursorShape shape) {
-    this->_cursor_mode_infos[i].shape = shape;
+    _shared->cursor_mode_infos[i].shape = shape;
   }
-  int CursorOffset() const { return _cursor.row * _size.cols + _cursor.col; }
   int CursorModeHighlightAttribute() const {
-    return this->_cursor.mode_info->hl_attrib_id;
+    return _shared->cursor_mode_info->hl_attrib_id;
   }
   void SetCursorModeHighlightAttribute(int i, int id) {
-    this->_cursor_mode_infos[i].hl_attrib_id = id;
+    _shared->cursor_mode_infos[i].hl_attrib_id = id;
   }
   void SetCursorModeInfo(size_t index) {
-    this->_cursor.mode_info = &this->_cursor_mode_infos[index];
+    _shared->cursor_mode_info = &_shared->cursor_mode_infos[index];
   }
 
-  HighlightAttribute &hl(size_t index) { return _hl[index]; }
-  const HighlightAttribute &hl(size_t index) const { return _hl[index]; }
+  const HighlightAttribute &hl(size_t index) const {
+    if (index == 0) {
+      return _shared->default_hl;
+    }
+    return index < _shared->hl.size() ? _shared->hl[index]
+                                      : _shared->undefined_hl;
+  }
+  // hl_attr_define. grows the table. index < MAX_HIGHLIGHT_ATTRIBS
+  void SetHighlightAttribute(size_t index, const HighlightAttribute &hl);
+  // default_colors_set. every id is resolved again
+  void SetDefaultColors(uint32_t foreground, uint32_t background,
+                        uint32_t special);
+  // Bumped on every change. An entry whose version is newer than the one a
+  // renderer saw has new resolved colors
+  uint64_t HighlightVersion() const { return _shared->hl_version; }
 };
 
 } // namespace Nvim
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "nvim_instance_pool.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <plog/Log.h>
+#include <string>
+#include <thread>
+
+// The consumer is unknown when a warm instance is launched.
+// The termination callback is forwarded through this slot.
+struct TerminatedSlot {
+  std::mutex _mutex;
+  on_terminated_t _callback;
+  bool _terminated = false;
+
+  void Terminated() {
+    on_terminated_t callback;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _terminated = true;
+      callback = _callback;
+    }
+    if (callback) {
+      callback();
+    }
+  }
+
+  // false if already dead
+  bool Set(const on_terminated_t &callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_terminated) {
+      return false;
+    }
+    _callback = callback;
+    return true;
+  }
+};
+
+struct WarmInstance {
+  std::unique_ptr<NvimFrontend> _frontend;
+  std::shared_ptr<TerminatedSlot> _slot;
+};
+
+class NvimInstancePoolImpl {
+  std::wstring _command;
+  size_t _size;
+  NvimIOPool *_io_pool;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<WarmInstance> _ready;
+  bool _stop = false;
+  // Acquire calls so far. a failed launch waits for the next one
+  uint64_t _acquired = 0;
+  std::thread _warmer;
+
+public:
+  NvimInstancePoolImpl(const wchar_t *command, int size, NvimIOPool *io_pool)
+      : _command(command), _size(size), _io_pool(io_pool),
+        _warmer([self = this]() { self->Refill(); }) {}
+
+  ~NvimInstancePoolImpl() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    _warmer.join();
+  }
+
+  std::unique_ptr<NvimFrontend> Acquire(const on_terminated_t &callback) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_acquired;
+    }
+    _cv.notify_all();
+    while (true) {
+      WarmInstance instance;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_ready.empty()) {
+          break;
+        }
+        instance = std::move(_ready.front());
+        _ready.pop_front();
+      }
+      _cv.notify_all();
+      if (instance._slot->Set(callback)) {
+        return std::move(instance._frontend);
+      }
+      // died while waiting in the pool. try next
+    }
+
+    // cold start
+    PLOGD << "(nvim) instance pool is empty";
+    auto frontend = std::make_unique<NvimFrontend>(_io_pool);
+    if (!frontend->Launch(_command.c_str(), callback)) {
+      return {};
+    }
+    return frontend;
+  }
+
+  int ReadyCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return static_cast<int>(_ready.size());
+  }
+
+private:
+  // warmer thread
+  void Refill() {
+    while (true) {
+      uint64_t acquired;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [self = this]() {
+          return self->_stop || self->_ready.size() < self->_size;
+        });
+        if (_stop) {
+          return;
+        }
+        acquired = _acquired;
+      }
+
+      WarmInstance instance{std::make_unique<NvimFrontend>(_io_pool),
+                            std::make_shared<TerminatedSlot>()};
+      if (!instance._frontend->Launch(
+              _command.c_str(),
+              [slot = instance._slot]() { slot->Terminated(); })) {
+        PLOGE << "(nvim) fail to launch pooled instance";
+        std::unique_lock<std::mutex> lock(_mutex);
+        // do not spin on a broken command line. wait for the next Acquire
+        _cv.wait(lock, [self = this, acquired]() {
+          return self->_stop || self->_acquired != acquired;
+        });
+        if (_stop) {
+          return;
+        }
+        continue;
+      }
+      // The handshake round trip is paid while the instance waits here, not
+      // by the pane. Not waited for: the answers stay queued in the transport
+      // until the pane's Initialize
+      instance._frontend->BeginInitialize();
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ready.push_back(std::move(instance));
+      }
+    }
+  }
+};
+
+NvimInstancePool::NvimInstancePool(const wchar_t *command, int size,
+                                   NvimIOPool *io_pool)
+    : _impl(new NvimInstancePoolImpl(command, size, io_pool)) {}
+
+NvimInstancePool::~NvimInstancePool() { delete _impl; }
+
+std::unique_ptr<NvimFrontend>
+NvimInstancePool::Acquire(const on_terminated_t &callback) {
+  return _impl->Acquire(callback);
+}
+
+int NvimInstancePool::ReadyCount() const { return _impl->ReadyCount(); }
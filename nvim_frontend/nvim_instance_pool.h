@@ -0,0 +1,28 @@
+#pragma once
+#include "nvim_frontend.h"
+#include <memory>
+
+// Keeps `size` nvim processes launched and handshaken (NvimFrontend::Launch
+// and BeginInitialize done) on a background thread, so opening a pane only
+// costs AttachUI and the first redraw. The warmer never waits on nvim, so a
+// stalled instance can not hang the pool's destructor.
+//
+// auto nvim = pool.Acquire([]() { /* terminated */ });
+// auto [font, size] = nvim->Initialize(); // answered already. does not block
+// nvim->AttachUI(&renderer, rows, cols);
+class NvimInstancePool {
+  class NvimInstancePoolImpl *_impl = nullptr;
+
+public:
+  NvimInstancePool(const wchar_t *command, int size,
+                   NvimIOPool *io_pool = nullptr);
+  ~NvimInstancePool();
+  NvimInstancePool(const NvimInstancePool &) = delete;
+  NvimInstancePool &operator=(const NvimInstancePool &) = delete;
+
+  // Take a warm instance and start refilling in the background.
+  // If none is ready, launch one on the calling thread.
+  // callback is invoked on an io thread
+  std::unique_ptr<NvimFrontend> Acquire(const on_terminated_t &callback);
+  int ReadyCount() const;
+};
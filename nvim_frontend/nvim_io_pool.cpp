@@ -0,0 +1,50 @@
+#include "nvim_io_pool.h"
+#include <algorithm>
+#include <asio.hpp>
+#include <thread>
+#include <vector>
+
+// reading pipes is cheap. a couple of threads serve dozens of panes
+constexpr int DEFAULT_THREAD_COUNT = 2;
+
+class NvimIOPoolImpl {
+  asio::io_context _context;
+  asio::executor_work_guard<asio::io_context::executor_type> _work;
+  std::vector<std::thread> _threads;
+
+public:
+  NvimIOPoolImpl(int thread_count) : _work(_context.get_executor()) {
+    for (int i = 0; i < thread_count; ++i) {
+      _threads.emplace_back([&context = _context]() { context.run(); });
+    }
+  }
+  ~NvimIOPoolImpl() {
+    _work.reset();
+    _context.stop();
+    for (auto &t : _threads) {
+      t.join();
+    }
+  }
+  asio::io_context &Context() { return _context; }
+  int ThreadCount() const { return static_cast<int>(_threads.size()); }
+};
+
+NvimIOPool::NvimIOPool(int thread_count) {
+  if (thread_count <= 0) {
+    thread_count = std::min(
+        DEFAULT_THREAD_COUNT,
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  }
+  _impl = new NvimIOPoolImpl(thread_count);
+}
+
+NvimIOPool::~NvimIOPool() { delete _impl; }
+
+asio::io_context &NvimIOPool::Context() { return _impl->Context(); }
+
+int NvimIOPool::ThreadCount() const { return _impl->ThreadCount(); }
+
+NvimIOPool &NvimIOPool::Default() {
+  static NvimIOPool s_pool;
+  return s_pool;
+}
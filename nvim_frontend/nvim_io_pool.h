@@ -0,0 +1,25 @@
+#pragma once
+#include <memory>
+
+namespace asio {
+class io_context;
+}
+
+// One asio::io_context run by a few threads, shared by every NvimFrontend.
+// Pipe reads/writes and process watching of all panes run here,
+// so thread count does not grow with the number of embedded nvim.
+class NvimIOPool {
+  class NvimIOPoolImpl *_impl = nullptr;
+
+public:
+  // thread_count == 0 => default
+  explicit NvimIOPool(int thread_count = 0);
+  ~NvimIOPool();
+  NvimIOPool(const NvimIOPool &) = delete;
+  NvimIOPool &operator=(const NvimIOPool &) = delete;
+  asio::io_context &Context();
+  int ThreadCount() const;
+
+  // used by NvimFrontend constructed without an explicit pool
+  static NvimIOPool &Default();
+};
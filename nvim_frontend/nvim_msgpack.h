@@ -0,0 +1,330 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+namespace Nvim {
+
+// Message framing on raw msgpack bytes, without building parser nodes.
+
+// big endian
+inline uint64_t MsgpackReadUInt(const uint8_t *p, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+// Scan of one msgpack object that may arrive in pieces. Feed the same
+// object head again with more bytes and only the new bytes are scanned, so a
+// big message costs one pass however many reads it takes. The state is
+// relative to the head, so the bytes may move between calls.
+struct MsgpackScan {
+  // whole items scanned so far. may point past the bytes given, into a
+  // string not received yet
+  size_t pos = 0;
+  // objects still to skip. an array or map adds its items
+  uint64_t remaining = 1;
+
+  // Byte size of the object at p, or 0 if it is not complete yet
+  size_t Resume(const uint8_t *p, size_t size) {
+    while (remaining) {
+      if (pos >= size) {
+        return 0;
+      }
+      auto item = pos;
+      uint8_t head = p[item++];
+
+      if (head <= 0x7f || head >= 0xe0) {
+        // positive / negative fixint
+        pos = item;
+        --remaining;
+        continue;
+      }
+      if ((head & 0xf0) == 0x80) {
+        // fixmap
+        pos = item;
+        remaining = remaining - 1 + 2 * (head & 0x0f);
+        continue;
+      }
+      if ((head & 0xf0) == 0x90) {
+        // fixarray
+        pos = item;
+        remaining = remaining - 1 + (head & 0x0f);
+        continue;
+      }
+      if ((head & 0xe0) == 0xa0) {
+        // fixstr
+        pos = item + (head & 0x1f);
+        --remaining;
+        continue;
+      }
+
+      // [length bytes, extra payload, container item count bytes, per item]
+      int length_bytes = 0;
+      size_t payload = 0;
+      int count_bytes = 0;
+      int per_item = 1;
+      switch (head) {
+      case 0xc0: // nil
+      case 0xc1: // never used
+      case 0xc2: // false
+      case 0xc3: // true
+        break;
+      case 0xc4: // bin 8
+      case 0xd9: // str 8
+        length_bytes = 1;
+        break;
+      case 0xc5: // bin 16
+      case 0xda: // str 16
+        length_bytes = 2;
+        break;
+      case 0xc6: // bin 32
+      case 0xdb: // str 32
+        length_bytes = 4;
+        break;
+      case 0xc7: // ext 8
+        length_bytes = 1;
+        payload = 1;
+        break;
+      case 0xc8: // ext 16
+        length_bytes = 2;
+        payload = 1;
+        break;
+      case 0xc9: // ext 32
+        length_bytes = 4;
+        payload = 1;
+        break;
+      case 0xca: // float 32
+        payload = 4;
+        break;
+      case 0xcb: // float 64
+        payload = 8;
+        break;
+      case 0xcc: // uint 8
+      case 0xd0: // int 8
+        payload = 1;
+        break;
+      case 0xcd: // uint 16
+      case 0xd1: // int 16
+        payload = 2;
+        break;
+      case 0xce: // uint 32
+      case 0xd2: // int 32
+        payload = 4;
+        break;
+      case 0xcf: // uint 64
+      case 0xd3: // int 64
+        payload = 8;
+        break;
+      case 0xd4: // fixext 1
+        payload = 2;
+        break;
+      case 0xd5: // fixext 2
+        payload = 3;
+        break;
+      case 0xd6: // fixext 4
+        payload = 5;
+        break;
+      case 0xd7: // fixext 8
+        payload = 9;
+        break;
+      case 0xd8: // fixext 16
+        payload = 17;
+        break;
+      case 0xdc: // array 16
+        count_bytes = 2;
+        break;
+      case 0xdd: // array 32
+        count_bytes = 4;
+        break;
+      case 0xde: // map 16
+        count_bytes = 2;
+        per_item = 2;
+        break;
+      case 0xdf: // map 32
+        count_bytes = 4;
+        per_item = 2;
+        break;
+      }
+
+      // the header is taken whole or not at all
+      uint64_t items = 0;
+      if (length_bytes) {
+        if (item + length_bytes > size) {
+          return 0;
+        }
+        payload += MsgpackReadUInt(p + item, length_bytes);
+        item += length_bytes;
+      }
+      if (count_bytes) {
+        if (item + count_bytes > size) {
+          return 0;
+        }
+        items = per_item * MsgpackReadUInt(p + item, count_bytes);
+        item += count_bytes;
+      }
+      pos = item + payload;
+      remaining = remaining - 1 + items;
+    }
+    return pos <= size ? pos : 0;
+  }
+};
+
+// Byte size of the first msgpack object in [p, p + size).
+// 0 if it is not complete yet.
+inline size_t MsgpackObjectSize(const uint8_t *p, size_t size) {
+  MsgpackScan scan;
+  return scan.Resume(p, size);
+}
+
+// Header of the msgpack array at p. Returns the header byte size and sets
+// count, or 0 if p is not an array or the header is incomplete.
+inline size_t MsgpackArrayHeader(const uint8_t *p, size_t size,
+                                 uint64_t *count) {
+  if (size == 0) {
+    return 0;
+  }
+  if ((p[0] & 0xf0) == 0x90) {
+    *count = p[0] & 0x0f;
+    return 1;
+  }
+  if (p[0] == 0xdc && size >= 3) {
+    *count = MsgpackReadUInt(p + 1, 2);
+    return 3;
+  }
+  if (p[0] == 0xdd && size >= 5) {
+    *count = MsgpackReadUInt(p + 1, 4);
+    return 5;
+  }
+  return 0;
+}
+
+// Locate the index-th item of the msgpack array at p.
+// return nullptr if p is not an array or index is out of range.
+inline const uint8_t *MsgpackArrayItem(const uint8_t *p, size_t size,
+                                       uint32_t index, size_t *item_size) {
+  uint64_t count;
+  size_t pos = MsgpackArrayHeader(p, size, &count);
+  if (!pos || index >= count) {
+    return nullptr;
+  }
+  for (uint32_t i = 0;; ++i) {
+    auto item = MsgpackObjectSize(p + pos, size - pos);
+    if (!item) {
+      return nullptr;
+    }
+    if (i == index) {
+      *item_size = item;
+      return p + pos;
+    }
+    pos += item;
+  }
+}
+
+//
+// Encoding into a caller buffer, for hot outgoing messages. Each returns the
+// end of what it wrote. The caller makes the buffer large enough:
+// array header <= 5, int <= 9, str <= 5 + size bytes.
+//
+
+// big endian
+constexpr uint8_t *MsgpackWriteUInt(uint8_t *p, uint64_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; --i) {
+    *p++ = static_cast<uint8_t>(value >> (i * 8));
+  }
+  return p;
+}
+
+constexpr uint8_t *MsgpackWriteArray(uint8_t *p, uint32_t count) {
+  if (count < 16) {
+    *p++ = static_cast<uint8_t>(0x90 | count);
+    return p;
+  }
+  if (count <= 0xffff) {
+    *p++ = 0xdc;
+    return MsgpackWriteUInt(p, count, 2);
+  }
+  *p++ = 0xdd;
+  return MsgpackWriteUInt(p, count, 4);
+}
+
+constexpr uint8_t *MsgpackWriteInt(uint8_t *p, int64_t value) {
+  if (value >= 0) {
+    if (value <= 0x7f) {
+      *p++ = static_cast<uint8_t>(value);
+      return p;
+    }
+    if (value <= 0xff) {
+      *p++ = 0xcc;
+      return MsgpackWriteUInt(p, value, 1);
+    }
+    if (value <= 0xffff) {
+      *p++ = 0xcd;
+      return MsgpackWriteUInt(p, value, 2);
+    }
+    if (value <= 0xffffffff) {
+      *p++ = 0xce;
+      return MsgpackWriteUInt(p, value, 4);
+    }
+    *p++ = 0xcf;
+    return MsgpackWriteUInt(p, value, 8);
+  }
+  if (value >= -32) {
+    *p++ = static_cast<uint8_t>(value);
+    return p;
+  }
+  if (value >= INT8_MIN) {
+    *p++ = 0xd0;
+    return MsgpackWriteUInt(p, static_cast<uint64_t>(value), 1);
+  }
+  if (value >= INT16_MIN) {
+    *p++ = 0xd1;
+    return MsgpackWriteUInt(p, static_cast<uint64_t>(value), 2);
+  }
+  if (value >= INT32_MIN) {
+    *p++ = 0xd2;
+    return MsgpackWriteUInt(p, static_cast<uint64_t>(value), 4);
+  }
+  *p++ = 0xd3;
+  return MsgpackWriteUInt(p, static_cast<uint64_t>(value), 8);
+}
+
+constexpr uint8_t *MsgpackWriteStr(uint8_t *p, std::string_view str) {
+  auto size = str.size();
+  if (size < 32) {
+    *p++ = static_cast<uint8_t>(0xa0 | size);
+  } else if (size <= 0xff) {
+    *p++ = 0xd9;
+    p = MsgpackWriteUInt(p, size, 1);
+  } else if (size <= 0xffff) {
+    *p++ = 0xda;
+    p = MsgpackWriteUInt(p, size, 2);
+  } else {
+    *p++ = 0xdb;
+    p = MsgpackWriteUInt(p, size, 4);
+  }
+  for (auto c : str) {
+    *p++ = static_cast<uint8_t>(c);
+  }
+  return p;
+}
+
+// [2, method, [arg0, ...]] up to arg0. Built at compile time, so sending
+// copies the prefix and encodes only the arguments.
+struct MsgpackNotifyPrefix {
+  static constexpr size_t CAPACITY = 48;
+  uint8_t data[CAPACITY] = {};
+  size_t size = 0;
+
+  constexpr MsgpackNotifyPrefix(std::string_view method, uint32_t arg_count) {
+    auto p = MsgpackWriteArray(data, 3);
+    p = MsgpackWriteInt(p, 2);
+    p = MsgpackWriteStr(p, method);
+    p = MsgpackWriteArray(p, arg_count);
+    size = p - data;
+  }
+};
+
+} // namespace Nvim
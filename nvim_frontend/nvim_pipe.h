@@ -2,13 +2,36 @@
 #include <functional>
 using on_terminated_t = std::function<void()>;
 
+namespace asio {
+class io_context;
+}
+
+#ifdef _WIN32
+using native_pipe_t = void *;
+#else
+using native_pipe_t = int;
+#endif
+
 class NvimPipe {
+  class NvimPipeImpl *_impl = nullptr;
+
 public:
   NvimPipe();
   ~NvimPipe();
   NvimPipe(const NvimPipe &) = delete;
   NvimPipe &operator=(const NvimPipe &) = delete;
-  bool Launch(const wchar_t *command_line, const on_terminated_t &callback);
-  void *ReadHandle();
-  void *WriteHandle();
+  // callback is invoked once, on any thread of context (the NvimIOPool), not
+  // the thread that called Launch. Post to the owner from it if needed.
+  // Not invoked once the pipe is deleted, but a call already started may
+  // still be running then, so it must not capture the pipe or its owner
+  bool Launch(asio::io_context &context, const wchar_t *command_line,
+              const on_terminated_t &callback);
+  // nvim stdout/stdin. ownership moves to the transport
+  native_pipe_t ReadHandle();
+  native_pipe_t WriteHandle();
+
+  // connect to `nvim --listen address`.
+  // unix domain socket path, or \\.\pipe\name on windows.
+  // ownership of out moves to the transport
+  static bool Connect(const wchar_t *address, native_pipe_t *out);
 };
@@ -0,0 +1,248 @@
+#include "nvim_pipe.h"
+#include "nvim_unicode.h"
+#include <asio.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <plog/Log.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <wchar.h>
+
+extern char **environ;
+
+// nvim can emit a full screen repaint in one burst.
+// A larger kernel pipe buffer lets it be drained with a few big reads.
+constexpr int PIPE_BUFFER_SIZE = 1024 * 1024;
+
+static std::string ToUtf8(const wchar_t *src) {
+  std::string utf8(wcslen(src) * 4, '\0');
+  utf8.resize(Nvim::Utf16ToUtf8(src, -1, utf8.data(), utf8.size()));
+  return utf8;
+}
+
+// "nvim --embed" => ["nvim", "--embed"]
+static std::vector<std::string> SplitCommandLine(const wchar_t *command_line) {
+  auto utf8 = ToUtf8(command_line);
+
+  std::vector<std::string> args;
+  std::string current;
+  bool in_quote = false;
+  bool has_token = false;
+  for (auto c : utf8) {
+    if (c == '"') {
+      in_quote = !in_quote;
+      has_token = true;
+    } else if (c == ' ' && !in_quote) {
+      if (has_token) {
+        args.push_back(current);
+        current.clear();
+        has_token = false;
+      }
+    } else {
+      current.push_back(c);
+      has_token = true;
+    }
+  }
+  if (has_token) {
+    args.push_back(current);
+  }
+  return args;
+}
+
+// Shared with the SIGCHLD handler. The handler runs on a pool thread and may
+// already be dequeued when NvimPipeImpl is deleted, so it holds this, not the
+// impl. The signal set is only touched on the strand.
+struct ChildWatch {
+  asio::strand<asio::io_context::executor_type> _strand;
+  asio::signal_set _sigchld;
+  on_terminated_t _callback;
+
+  std::mutex _mutex;
+  // with _mutex. -1 before spawn and once reaped
+  pid_t _pid = -1;
+  // with _mutex. NvimPipeImpl is gone, the callback is not invoked
+  bool _closed = false;
+
+  ChildWatch(asio::io_context &context)
+      : _strand(asio::make_strand(context)), _sigchld(_strand, SIGCHLD) {}
+
+  static void Cancel(const std::shared_ptr<ChildWatch> &watch) {
+    asio::post(watch->_strand, [watch]() { watch->_sigchld.cancel(); });
+  }
+
+  static void WaitTermination(const std::shared_ptr<ChildWatch> &watch) {
+    watch->_sigchld.async_wait([watch](const asio::error_code &ec, int) {
+      if (ec) {
+        // canceled
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(watch->_mutex);
+        if (watch->_closed) {
+          return;
+        }
+        // SIGCHLD is shared by every child of the process. Only our pid
+        // counts
+        if (watch->_pid == -1 ||
+            waitpid(watch->_pid, nullptr, WNOHANG) != watch->_pid) {
+          WaitTermination(watch);
+          return;
+        }
+        watch->_pid = -1;
+      }
+      PLOGD << "(nvim) terminated";
+      watch->_callback();
+    });
+  }
+};
+
+class NvimPipeImpl {
+  int _stdin_write = -1;
+  int _stdout_read = -1;
+  std::shared_ptr<ChildWatch> _watch;
+
+public:
+  NvimPipeImpl(asio::io_context &context)
+      : _watch(std::make_shared<ChildWatch>(context)) {}
+
+  ~NvimPipeImpl() {
+    {
+      // a handler running now either reaped first or sees _closed
+      std::lock_guard<std::mutex> lock(_watch->_mutex);
+      _watch->_closed = true;
+      if (_watch->_pid != -1) {
+        if (waitpid(_watch->_pid, nullptr, WNOHANG) == 0) {
+          kill(_watch->_pid, SIGTERM);
+          waitpid(_watch->_pid, nullptr, 0);
+        }
+        _watch->_pid = -1;
+      }
+    }
+    // after _closed. a wait armed before it is canceled here
+    ChildWatch::Cancel(_watch);
+  }
+
+  int ReadHandle() const { return _stdout_read; }
+  int WriteHandle() const { return _stdin_write; }
+
+  bool Launch(const wchar_t *command_line, const on_terminated_t &callback) {
+    auto args = SplitCommandLine(command_line);
+    if (args.empty()) {
+      PLOGE << "(nvim) empty command line";
+      return false;
+    }
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    int stdin_pipe[2];
+    if (pipe2(stdin_pipe, O_CLOEXEC) != 0) {
+      PLOGE << "(nvim) fail to pipe for stdin";
+      return false;
+    }
+    int stdout_pipe[2];
+    if (pipe2(stdout_pipe, O_CLOEXEC) != 0) {
+      PLOGE << "(nvim) fail to pipe for stdout";
+      close(stdin_pipe[0]);
+      close(stdin_pipe[1]);
+      return false;
+    }
+#ifdef F_SETPIPE_SZ
+    fcntl(stdout_pipe[0], F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+#endif
+
+    // our side never blocks. asio drains it from the context thread
+    fcntl(stdin_pipe[1], F_SETFL, fcntl(stdin_pipe[1], F_GETFL) | O_NONBLOCK);
+    fcntl(stdout_pipe[0], F_SETFL,
+          fcntl(stdout_pipe[0], F_GETFL) | O_NONBLOCK);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdin_pipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stdout_pipe[1], STDOUT_FILENO);
+
+    // register before spawn. a short lived child must not be missed.
+    // the handler waits on the mutex until _pid is known
+    _watch->_callback = callback;
+    int result;
+    {
+      std::lock_guard<std::mutex> lock(_watch->_mutex);
+      asio::post(_watch->_strand, [watch = _watch]() {
+        ChildWatch::WaitTermination(watch);
+      });
+      pid_t pid;
+      result = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(),
+                            environ);
+      if (result == 0) {
+        _watch->_pid = pid;
+      } else {
+        _watch->_closed = true;
+      }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(stdin_pipe[0]);
+    close(stdout_pipe[1]);
+    if (result != 0) {
+      PLOGE << "(nvim) fail to posix_spawn: " << strerror(result);
+      ChildWatch::Cancel(_watch);
+      close(stdin_pipe[1]);
+      close(stdout_pipe[0]);
+      return false;
+    }
+
+    _stdin_write = stdin_pipe[1];
+    _stdout_read = stdout_pipe[0];
+    return true;
+  }
+};
+
+NvimPipe::NvimPipe() {}
+
+NvimPipe::~NvimPipe() { delete _impl; }
+
+native_pipe_t NvimPipe::ReadHandle() { return _impl->ReadHandle(); }
+
+native_pipe_t NvimPipe::WriteHandle() { return _impl->WriteHandle(); }
+
+bool NvimPipe::Launch(asio::io_context &context, const wchar_t *command_line,
+                      const on_terminated_t &callback) {
+  delete _impl;
+  _impl = new NvimPipeImpl(context);
+  return _impl->Launch(command_line, callback);
+}
+
+bool NvimPipe::Connect(const wchar_t *address, native_pipe_t *out) {
+  auto path = ToUtf8(address);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    PLOGE << "(nvim) invalid socket path: " << path;
+    return false;
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    PLOGE << "(nvim) fail to socket: " << strerror(errno);
+    return false;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    PLOGE << "(nvim) fail to connect " << path << ": " << strerror(errno);
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  *out = fd;
+  return true;
+}
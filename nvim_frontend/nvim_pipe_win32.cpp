@@ -0,0 +1,201 @@
+#include "nvim_pipe.h"
+#include <Windows.h>
+#include <asio.hpp>
+#include <atomic>
+#include <msgpackpp/msgpackpp.h>
+#include <plog/Log.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+constexpr DWORD PIPE_BUFFER_SIZE = 1024 * 1024;
+
+// Anonymous pipes from CreatePipe can not do overlapped io, so asio can not
+// wait on them from a shared io_context. Our ends are overlapped named pipes,
+// nvim gets plain synchronous handles to the same pipes.
+static bool CreateOverlappedPipe(bool inbound, HANDLE *ours, HANDLE *child) {
+  static std::atomic<uint32_t> s_serial = 0;
+  auto name = std::string("\\\\.\\pipe\\nvim_texture.") +
+              std::to_string(GetCurrentProcessId()) + "." +
+              std::to_string(s_serial++);
+
+  *ours = CreateNamedPipeA(
+      name.c_str(),
+      (inbound ? PIPE_ACCESS_INBOUND : PIPE_ACCESS_OUTBOUND) |
+          FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+      PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1,
+      PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE, 0, nullptr);
+  if (*ours == INVALID_HANDLE_VALUE) {
+    *ours = nullptr;
+    return false;
+  }
+
+  SECURITY_ATTRIBUTES sec_attribs = {sizeof(SECURITY_ATTRIBUTES)};
+  sec_attribs.bInheritHandle = true;
+  *child = CreateFileA(name.c_str(), inbound ? GENERIC_WRITE : GENERIC_READ, 0,
+                       &sec_attribs, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                       nullptr);
+  if (*child == INVALID_HANDLE_VALUE) {
+    CloseHandle(*ours);
+    *ours = nullptr;
+    return false;
+  }
+  return true;
+}
+
+class NvimPipeImpl {
+  HANDLE _stdin_write = nullptr;
+  HANDLE _stdout_read = nullptr;
+  HANDLE _job_object = nullptr;
+  asio::windows::object_handle _process;
+
+public:
+  NvimPipeImpl(asio::io_context &context) : _process(context) {}
+
+  ~NvimPipeImpl() {
+    if (_process.is_open()) {
+      DWORD exit_code;
+      GetExitCodeProcess(_process.native_handle(), &exit_code);
+      if (exit_code == STILL_ACTIVE) {
+        TerminateProcess(_process.native_handle(), 0);
+        WaitForSingleObject(_process.native_handle(), INFINITE);
+      }
+      asio::error_code ec;
+      _process.close(ec);
+    }
+    if (_job_object) {
+      CloseHandle(_job_object);
+    }
+  }
+
+  HANDLE ReadHandle() const { return _stdout_read; }
+  HANDLE WriteHandle() const { return _stdin_write; }
+
+  // ours go to the transport only after a successful Launch
+  void CloseOurs() {
+    for (auto handle : {&_stdin_write, &_stdout_read}) {
+      if (*handle) {
+        CloseHandle(*handle);
+        *handle = nullptr;
+      }
+    }
+  }
+
+  // wchar_t command_line[] = L"nvim --embed";
+  bool Launch(const wchar_t *command_line, const on_terminated_t &callback) {
+    HANDLE child_stdin;
+    if (!CreateOverlappedPipe(false, &_stdin_write, &child_stdin)) {
+      PLOGE << "(nvim) fail to CreatePipe for stdin";
+      return false;
+    }
+    HANDLE child_stdout;
+    if (!CreateOverlappedPipe(true, &_stdout_read, &child_stdout)) {
+      PLOGE << "(nvim) fail to CreatePipe for stdout";
+      CloseHandle(child_stdin);
+      CloseOurs();
+      return false;
+    }
+
+    // Launches run concurrently (see NvimInstancePool). Inherit only these
+    // two, or a child also gets the pipe ends of another being launched and
+    // that one's stdout never reaches eof when it exits.
+    HANDLE inherited[] = {child_stdin, child_stdout};
+    SIZE_T attribute_size = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attribute_size);
+    std::vector<uint8_t> attribute_buffer(attribute_size);
+    auto attributes =
+        reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attribute_buffer.data());
+    if (!InitializeProcThreadAttributeList(attributes, 1, 0,
+                                           &attribute_size)) {
+      PLOGE << "(nvim) fail to InitializeProcThreadAttributeList";
+      CloseHandle(child_stdin);
+      CloseHandle(child_stdout);
+      CloseOurs();
+      return false;
+    }
+    UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                              inherited, sizeof(inherited), nullptr, nullptr);
+
+    STARTUPINFOEXW startup_info = {{sizeof(STARTUPINFOEXW)}};
+    startup_info.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startup_info.StartupInfo.hStdInput = child_stdin;
+    startup_info.StartupInfo.hStdOutput = child_stdout;
+    startup_info.StartupInfo.hStdError = child_stdout;
+    startup_info.lpAttributeList = attributes;
+    PROCESS_INFORMATION process_info = {0};
+    auto created = CreateProcessW(
+        nullptr, std::wstring(command_line).data(), nullptr, nullptr, true,
+        CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, nullptr, nullptr,
+        &startup_info.StartupInfo, &process_info);
+    DeleteProcThreadAttributeList(attributes);
+    // nvim has its own copies now
+    CloseHandle(child_stdin);
+    CloseHandle(child_stdout);
+    if (!created) {
+      PLOGE << "(nvim) fail to CreateProcess";
+
+      LPVOID lpvMessageBuffer;
+      FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
+                    NULL, GetLastError(),
+                    MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+                    (LPTSTR)&lpvMessageBuffer, 0, NULL);
+      PLOGE << (const char *)lpvMessageBuffer;
+      LocalFree(lpvMessageBuffer);
+
+      CloseOurs();
+      return false;
+    }
+    CloseHandle(process_info.hThread);
+    _process.assign(process_info.hProcess);
+
+    // runs on a pool thread and may already be dequeued when this is
+    // deleted. holds its own copy of the callback, not this
+    _process.async_wait([callback](const asio::error_code &ec) {
+      if (ec) {
+        // canceled
+        return;
+      }
+      PLOGD << "(nvim) terminated";
+      callback();
+    });
+
+    _job_object = CreateJobObjectW(nullptr, nullptr);
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info = {0};
+    job_info.BasicLimitInformation.LimitFlags =
+        JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+
+    SetInformationJobObject(_job_object, JobObjectExtendedLimitInformation,
+                            &job_info, sizeof(job_info));
+    AssignProcessToJobObject(_job_object, process_info.hProcess);
+
+    return true;
+  }
+};
+
+NvimPipe::NvimPipe() {}
+
+NvimPipe::~NvimPipe() { delete _impl; }
+
+native_pipe_t NvimPipe::ReadHandle() { return _impl->ReadHandle(); }
+
+native_pipe_t NvimPipe::WriteHandle() { return _impl->WriteHandle(); }
+
+bool NvimPipe::Launch(asio::io_context &context, const wchar_t *command_line,
+                      const on_terminated_t &callback) {
+  delete _impl;
+  _impl = new NvimPipeImpl(context);
+  return _impl->Launch(command_line, callback);
+}
+
+bool NvimPipe::Connect(const wchar_t *address, native_pipe_t *out) {
+  // overlapped for the shared io_context
+  HANDLE handle =
+      CreateFileW(address, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                  OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    PLOGE << "(nvim) fail to connect: " << GetLastError();
+    return false;
+  }
+  *out = handle;
+  return true;
+}
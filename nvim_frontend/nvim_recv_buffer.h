@@ -0,0 +1,165 @@
+#pragma once
+#include "nvim_msgpack.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <tuple>
+#include <vector>
+
+// Receive buffer shared by the io thread (producer) and the owner thread
+// (consumer). The transport reads straight into the free tail and the rpc
+// parses complete messages where they lie, tracked as offsets.
+//
+// |consumed| pending messages | free tail (read in flight) |
+//          _read_pos          _write_pos                  capacity
+//
+// The producer only ever touches the free tail. Reclaiming space (reset to
+// the front, moving a partial message, growing for a huge message) is done
+// by the consumer, and only while no read is in flight. After warm-up nothing
+// is allocated and only partial message tails are ever moved.
+class NvimRecvBuffer {
+public:
+  static constexpr size_t INITIAL_CAPACITY = 1024 * 1024;
+  // do not issue reads smaller than this. ask the consumer to reclaim
+  static constexpr size_t MIN_READ_SIZE = 64 * 1024;
+
+private:
+  std::vector<uint8_t> _buffer;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  size_t _read_pos = 0;
+  size_t _write_pos = 0;
+  // consumer has seen everything up to here
+  size_t _seen_pos = 0;
+  bool _reading = false;
+  bool _closed = false;
+  // consumer only. how far the message at _read_pos has been scanned, so a
+  // big one arriving over many reads is not scanned from its head each time
+  Nvim::MsgpackScan _head_scan;
+
+public:
+  NvimRecvBuffer() : _buffer(INITIAL_CAPACITY) {}
+  NvimRecvBuffer(const NvimRecvBuffer &) = delete;
+  NvimRecvBuffer &operator=(const NvimRecvBuffer &) = delete;
+
+  //
+  // producer (io thread)
+  //
+
+  // Free tail for the first read. {nullptr, 0} if a read is already running
+  std::tuple<uint8_t *, size_t> BeginRead() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_reading || _closed) {
+      return {};
+    }
+    return NextRead();
+  }
+
+  // Publish size bytes. Returns the free tail for the next read,
+  // or {nullptr, 0} when the consumer has to reclaim space first.
+  std::tuple<uint8_t *, size_t> EndRead(size_t size) {
+    std::tuple<uint8_t *, size_t> next;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _write_pos += size;
+      _reading = false;
+      next = NextRead();
+    }
+    _cv.notify_all();
+    return next;
+  }
+
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _closed = true;
+      _reading = false;
+    }
+    _cv.notify_all();
+  }
+
+  //
+  // consumer (owner thread)
+  //
+
+  // Block until new bytes arrive. false if closed.
+  bool Wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [self = this]() {
+      return self->_write_pos != self->_seen_pos || self->_closed;
+    });
+    return _write_pos != _seen_pos;
+  }
+
+  bool Closed() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _closed;
+  }
+
+  // on_message(const uint8_t *data, size_t size) for each complete message.
+  // on_partial(const uint8_t *data, size_t size) for the incomplete message
+  // after them, if any. The same head is passed again with more bytes on the
+  // next call. data points into the buffer and is valid only during the call.
+  // Returns the free tail when the stalled producer has to be restarted.
+  template <typename F, typename P>
+  std::tuple<uint8_t *, size_t> Consume(const F &on_message,
+                                        const P &on_partial) {
+    size_t begin;
+    size_t end;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      begin = _read_pos;
+      end = _write_pos;
+      _seen_pos = end;
+    }
+
+    auto p = _buffer.data();
+    while (begin < end) {
+      auto size = _head_scan.Resume(p + begin, end - begin);
+      if (!size) {
+        // partial message. wait for more bytes
+        on_partial(p + begin, end - begin);
+        break;
+      }
+      _head_scan = {};
+      on_message(p + begin, size);
+      begin += size;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _read_pos = begin;
+    if (_reading || _closed) {
+      return {};
+    }
+    if (_buffer.size() - _write_pos >= MIN_READ_SIZE) {
+      // the producer was restarted already or will be by EndRead
+      return NextRead();
+    }
+
+    // the producer stalled on a short tail. reclaim
+    auto pending = _write_pos - _read_pos;
+    if (pending && _read_pos) {
+      memmove(_buffer.data(), _buffer.data() + _read_pos, pending);
+    }
+    _read_pos = 0;
+    _write_pos = pending;
+    _seen_pos = pending;
+    if (_buffer.size() - _write_pos < MIN_READ_SIZE) {
+      // one message is larger than the whole buffer
+      _buffer.resize(_buffer.size() * 2);
+    }
+    return NextRead();
+  }
+
+private:
+  // with lock
+  std::tuple<uint8_t *, size_t> NextRead() {
+    auto free = _buffer.size() - _write_pos;
+    if (free < MIN_READ_SIZE) {
+      return {};
+    }
+    _reading = true;
+    return {_buffer.data() + _write_pos, free};
+  }
+};
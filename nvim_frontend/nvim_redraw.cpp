@@ -1,9 +1,14 @@
 #include "nvim_redraw.h"
+#include "nvim_redraw_event.h"
 #include "nvim_grid.h"
 #include "nvim_renderer.h"
-#include <Windows.h>
+#include "nvim_trace.h"
+#include "nvim_unicode.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <msgpackpp/msgpackpp.h>
-#include <plog/Log.h>
 
 // font_name:h14
 std::tuple<std::string_view, float>
@@ -12,332 +17,876 @@ NvimRedraw::ParseGUIFont(std::string_view guifont) {
   if (size_str == std::string::npos) {
     return {};
   }
-  std::string font_size_str(guifont.begin() + size_str + 2, guifont.end());
-  auto font_size = static_cast<float>(atof(font_size_str.c_str()));
+  // atof needs a terminator. copy to the stack, not the heap
+  char font_size_str[32];
+  auto size_len = std::min(guifont.size() - (size_str + 2),
+                           sizeof(font_size_str) - 1);
+  memcpy(font_size_str, guifont.data() + size_str + 2, size_len);
+  font_size_str[size_len] = '\0';
+  auto font_size = static_cast<float>(atof(font_size_str));
   return {guifont.substr(0, size_str), font_size};
 }
 
 void NvimRedraw::Dispatch(Nvim::Grid *grid, NvimRenderer *renderer,
                           const msgpackpp::parser &params) {
-  auto [w, h] = renderer->StartDraw();
-
   auto redraw_commands_length = params.count();
   auto redraw_command_arr = params.first_array_item().value;
   for (uint64_t i = 0; i < redraw_commands_length;
        ++i, redraw_command_arr = redraw_command_arr.next()) {
-    auto redraw_command_name = redraw_command_arr[0].get_string();
-    if (redraw_command_name == "option_set") {
-      SetGuiOptions(renderer, redraw_command_arr);
-    }
-    if (redraw_command_name == "grid_resize") {
-      UpdateGridSize(grid, redraw_command_arr);
-    }
-    if (redraw_command_name == "grid_clear") {
-      grid->Clear();
-      renderer->DrawBackgroundRect(grid->Rows(), grid->Cols(), &grid->hl(0));
-    } else if (redraw_command_name == "default_colors_set") {
-      UpdateDefaultColors(grid, redraw_command_arr);
-    } else if (redraw_command_name == "hl_attr_define") {
-      UpdateHighlightAttributes(grid, redraw_command_arr);
-    } else if (redraw_command_name == "grid_line") {
-      DrawGridLines(grid, renderer, redraw_command_arr);
-    } else if (redraw_command_name == "grid_cursor_goto") {
-      // If the old cursor position is still within the row
-      // bounds, redraw the line to get rid of the cursor
-      if (grid->CursorRow() < grid->Rows()) {
-        renderer->DrawGridLine(grid, grid->CursorRow());
-      }
-      UpdateCursorPos(grid, redraw_command_arr);
-    } else if (redraw_command_name == "mode_info_set") {
-      UpdateCursorModeInfos(grid, redraw_command_arr);
-    } else if (redraw_command_name == "mode_change") {
-      // Redraw cursor if its inside the bounds
-      if (grid->CursorRow() < grid->Rows()) {
-        renderer->DrawGridLine(grid, grid->CursorRow());
-      }
-      UpdateCursorMode(grid, redraw_command_arr);
-    } else if (redraw_command_name == "busy_start") {
-      this->_ui_busy = true;
-      // Hide cursor while UI is busy
-      if (grid->CursorRow() < grid->Rows()) {
-        renderer->DrawGridLine(grid, grid->CursorRow());
-      }
-    } else if (redraw_command_name == "busy_stop") {
-      this->_ui_busy = false;
-    } else if (redraw_command_name == "grid_scroll") {
-      ScrollRegion(grid, renderer, redraw_command_arr);
-    } else if (redraw_command_name == "flush") {
-      if (!this->_ui_busy) {
-        renderer->DrawCursor(grid);
-      }
-      renderer->DrawBorderRectangles(grid, w, h);
-      renderer->FinishDraw();
-    } else {
-      // PLOGD << "unknown:" << redraw_command_name;
-    }
+    DispatchEvent(grid, renderer, redraw_command_arr);
   }
 }
 
-void NvimRedraw::SetGuiOptions(NvimRenderer *renderer,
-                               const msgpackpp::parser &option_set) {
-  uint64_t option_set_length = option_set.count();
+void NvimRedraw::DispatchEvent(Nvim::Grid *grid, NvimRenderer *renderer,
+                               const msgpackpp::parser &event) {
+  auto type = Nvim::ToRedrawEvent(event[0].get_string());
+  uint64_t count = event.count();
+  auto args = event.first_array_item().value;
+  for (uint64_t i = 1; i < count; ++i) {
+    args = args.next().value;
+    DispatchArgs(grid, renderer, type, args);
+  }
+}
 
-  auto item = option_set.first_array_item().value.next().value;
-  for (uint64_t i = 1; i < option_set_length; ++i, item = item.next()) {
-    auto name = item[0].get_string();
-    if (name == "guifont") {
-      auto [font, size] = ParseGUIFont(item[1].get_string());
-      renderer->SetFont(font, size);
-    }
+void NvimRedraw::DispatchArgs(Nvim::Grid *grid, NvimRenderer *renderer,
+                              const msgpackpp::parser &name,
+                              const msgpackpp::parser &args) {
+  DispatchArgs(grid, renderer, Nvim::ToRedrawEvent(name.get_string()), args);
+}
+
+// Decoded as soon as the tuple is received, while the rest of the batch may
+// still be arriving. The batch is applied at flush, or earlier once it holds
+// MAX_PENDING_BYTES, so a huge batch does not grow the arena without bound.
+// Nothing is drawn before flush either way.
+void NvimRedraw::DispatchArgs(Nvim::Grid *grid, NvimRenderer *renderer,
+                              Nvim::RedrawEvent event,
+                              const msgpackpp::parser &args) {
+  DecodeArgs(event, args);
+  if (event == Nvim::RedrawEvent::Flush ||
+      _arena.Used() + _batch.size() * sizeof(Nvim::RedrawRecord) >=
+          MAX_PENDING_BYTES) {
+    Apply(grid, renderer);
+  }
+}
+
+//
+// decode
+//
+
+static std::string_view CopyString(Nvim::Arena &arena, std::string_view src) {
+  if (src.empty()) {
+    // right half of a wide char
+    return {};
+  }
+  auto p = arena.Allocate<char>(src.size());
+  memcpy(p, src.data(), src.size());
+  return {p, src.size()};
+}
+
+std::string_view NvimRedraw::CopyString(std::string_view src) {
+  return ::CopyString(_arena, src);
+}
+
+void NvimRedraw::Decode(const msgpackpp::parser &redraw_command_arr) {
+  auto type = Nvim::ToRedrawEvent(redraw_command_arr[0].get_string());
+  uint64_t count = redraw_command_arr.count();
+  auto args = redraw_command_arr.first_array_item().value;
+  for (uint64_t i = 1; i < count; ++i) {
+    args = args.next().value;
+    DecodeArgs(type, args);
+  }
+}
+
+void NvimRedraw::DecodeArgs(Nvim::RedrawEvent event,
+                            const msgpackpp::parser &args) {
+  using Decoder = void (NvimRedraw::*)(const msgpackpp::parser &);
+  // indexed by Nvim::RedrawEvent
+  static constexpr Decoder DECODERS[] = {
+      &NvimRedraw::DecodeUnknown,
+      &NvimRedraw::DecodeOptionSet,
+      &NvimRedraw::DecodeGridResize,
+      &NvimRedraw::DecodeGridClear,
+      &NvimRedraw::DecodeDefaultColors,
+      &NvimRedraw::DecodeHighlightAttributes,
+      &NvimRedraw::DecodeGridLine,
+      &NvimRedraw::DecodeCursorPos,
+      &NvimRedraw::DecodeCursorModeInfos,
+      &NvimRedraw::DecodeCursorMode,
+      &NvimRedraw::DecodeNoArgs<Nvim::RedrawEvent::BusyStart>,
+      &NvimRedraw::DecodeNoArgs<Nvim::RedrawEvent::BusyStop>,
+      &NvimRedraw::DecodeScrollRegion,
+      &NvimRedraw::DecodeNoArgs<Nvim::RedrawEvent::Flush>,
+      &NvimRedraw::DecodeWinPos,
+      &NvimRedraw::DecodeWinFloatPos,
+      &NvimRedraw::DecodeWinHide<Nvim::RedrawEvent::WinHide>,
+      &NvimRedraw::DecodeWinHide<Nvim::RedrawEvent::WinClose>,
+      &NvimRedraw::DecodeWinHide<Nvim::RedrawEvent::GridDestroy>,
+      &NvimRedraw::DecodeMsgSetPos,
+  };
+  static_assert(sizeof(DECODERS) / sizeof(DECODERS[0]) ==
+                static_cast<size_t>(Nvim::RedrawEvent::Count));
+
+  (this->*DECODERS[static_cast<size_t>(event)])(args);
+}
+
+void NvimRedraw::DecodeUnknown(const msgpackpp::parser &) {
+  ++_stats.unknown_events;
+}
+
+// busy_start, busy_stop, flush: []
+template <Nvim::RedrawEvent E>
+void NvimRedraw::DecodeNoArgs(const msgpackpp::parser &) {
+  Nvim::RedrawRecord record;
+  record.type = E;
+  _batch.push_back(record);
+}
+
+// ["option_set",["arabicshape",true],["ambiwidth","single"],...
+void NvimRedraw::DecodeOptionSet(const msgpackpp::parser &option) {
+  auto name = option[0].get_string();
+  if (name == "guifont") {
+    auto guifont = CopyString(option[1].get_string());
+    Nvim::RedrawRecord record;
+    record.type = Nvim::RedrawEvent::OptionSet;
+    record.option_set = {guifont.data(), static_cast<uint32_t>(guifont.size())};
+    _batch.push_back(record);
   }
 }
 
 // ["grid_resize",[1,190,45]]
-void NvimRedraw::UpdateGridSize(Nvim::Grid *grid,
-                                const msgpackpp::parser &grid_resize) {
-  auto grid_resize_params = grid_resize[1];
-  int grid_cols = grid_resize_params[1].get_number<int>();
-  int grid_rows = grid_resize_params[2].get_number<int>();
-  grid->RowsCols(grid_rows, grid_cols);
-  _sizing = false;
+void NvimRedraw::DecodeGridResize(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::GridResize;
+  record.grid_resize = {
+      params[0].get_number<int>(),
+      params[1].get_number<int>(),
+      params[2].get_number<int>(),
+  };
+  _batch.push_back(record);
+}
+
+// ["grid_clear",[1]]
+void NvimRedraw::DecodeGridClear(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::GridClear;
+  record.grid_clear = {params[0].get_number<int>()};
+  _batch.push_back(record);
 }
 
 // ["grid_cursor_goto",[1,0,4]]
-void NvimRedraw::UpdateCursorPos(Nvim::Grid *grid,
-                                 const msgpackpp::parser &cursor_goto) {
-  auto cursor_goto_params = cursor_goto[1];
-  auto row = cursor_goto_params[1].get_number<int>();
-  auto col = cursor_goto_params[2].get_number<int>();
-  grid->SetCursor(row, col);
+void NvimRedraw::DecodeCursorPos(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::GridCursorGoto;
+  record.grid_cursor_goto = {
+      params[0].get_number<int>(),
+      params[1].get_number<int>(),
+      params[2].get_number<int>(),
+  };
+  _batch.push_back(record);
 }
 
 // ["mode_info_set",[true,[{"mouse_shape":0...
-void NvimRedraw::UpdateCursorModeInfos(
-    Nvim::Grid *grid, const msgpackpp::parser &mode_info_set_params) {
-  auto mode_info_params = mode_info_set_params[1];
+void NvimRedraw::DecodeCursorModeInfos(
+    const msgpackpp::parser &mode_info_params) {
   auto mode_infos = mode_info_params[1];
   size_t mode_infos_length = mode_infos.count();
   assert(mode_infos_length <= Nvim::MAX_CURSOR_MODE_INFOS);
-
-  for (size_t i = 0; i < mode_infos_length; ++i) {
-    auto mode_info_map = mode_infos[i];
-    grid->SetCursorShape(i, Nvim::CursorShape::None);
-
+  mode_infos_length = std::min(
+      mode_infos_length, static_cast<size_t>(Nvim::MAX_CURSOR_MODE_INFOS));
+
+  auto infos = _arena.Allocate<Nvim::ModeInfo>(mode_infos_length);
+  auto mode_info_map = mode_infos.first_array_item().value;
+  for (size_t i = 0; i < mode_infos_length;
+       ++i, mode_info_map = mode_info_map.next()) {
+    infos[i].shape = Nvim::CursorShape::None;
     auto cursor_shape = mode_info_map["cursor_shape"];
     if (cursor_shape.is_string()) {
       auto cursor_shape_str = cursor_shape.get_string();
       if (cursor_shape_str == "block") {
-        grid->SetCursorShape(i, Nvim::CursorShape::Block);
+        infos[i].shape = Nvim::CursorShape::Block;
       } else if (cursor_shape_str == "vertical") {
-        grid->SetCursorShape(i, Nvim::CursorShape::Vertical);
+        infos[i].shape = Nvim::CursorShape::Vertical;
       } else if (cursor_shape_str == "horizontal") {
-        grid->SetCursorShape(i, Nvim::CursorShape::Horizontal);
+        infos[i].shape = Nvim::CursorShape::Horizontal;
       }
     }
 
-    grid->SetCursorModeHighlightAttribute(i, 0);
+    infos[i].attr_id = 0;
     auto hl_attrib_index = mode_info_map["attr_id"];
     if (hl_attrib_index.is_number()) {
-      grid->SetCursorModeHighlightAttribute(i,
-                                            hl_attrib_index.get_number<int>());
+      infos[i].attr_id = hl_attrib_index.get_number<int>();
     }
   }
+
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::ModeInfoSet;
+  record.mode_info_set = {infos, static_cast<uint32_t>(mode_infos_length)};
+  _batch.push_back(record);
 }
 
 // ["mode_change",["normal",0]]
-void NvimRedraw::UpdateCursorMode(Nvim::Grid *grid,
-                                  const msgpackpp::parser &mode_change) {
-  auto mode_change_params = mode_change[1];
-  grid->SetCursorModeInfo(mode_change_params[1].get_number<int>());
+void NvimRedraw::DecodeCursorMode(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::ModeChange;
+  record.mode_change = {params[1].get_number<int>()};
+  _batch.push_back(record);
 }
 
 // ["default_colors_set",[1.67772e+07,0,1.67117e+07,0,0]]
-void NvimRedraw::UpdateDefaultColors(Nvim::Grid *grid,
-                                     const msgpackpp::parser &default_colors) {
-  size_t default_colors_arr_length = default_colors.count();
-  for (size_t i = 1; i < default_colors_arr_length; ++i) {
-    auto color_arr = default_colors[i];
-
-    // Default colors occupy the first index of the highlight attribs
-    // array
-    auto &defaultHL = grid->hl(0);
-
-    defaultHL.foreground = color_arr[0].get_number<uint32_t>();
-    defaultHL.background = color_arr[1].get_number<uint32_t>();
-    defaultHL.special = color_arr[2].get_number<uint32_t>();
-    defaultHL.flags = 0;
-  }
+void NvimRedraw::DecodeDefaultColors(const msgpackpp::parser &color_arr) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::DefaultColorsSet;
+  record.default_colors_set = {
+      color_arr[0].get_number<uint32_t>(),
+      color_arr[1].get_number<uint32_t>(),
+      color_arr[2].get_number<uint32_t>(),
+  };
+  _batch.push_back(record);
 }
 
 // ["hl_attr_define",[1,{},{},[]],[2,{"foreground":1.38823e+07,"background":1.1119e+07},{"for
-void NvimRedraw::UpdateHighlightAttributes(
-    Nvim::Grid *grid, const msgpackpp::parser &highlight_attribs) {
-  uint64_t attrib_count = highlight_attribs.count();
-  for (uint64_t i = 1; i < attrib_count; ++i) {
-    int64_t attrib_index = highlight_attribs[i][0].get_number<int>();
-
-    auto attrib_map = highlight_attribs[i][1];
-
-    const auto SetColor = [&](const char *name, uint32_t *color) {
-      auto color_node = attrib_map[name];
-      if (color_node.is_number()) {
-        *color = color_node.get_number<uint32_t>();
+void NvimRedraw::DecodeHighlightAttributes(const msgpackpp::parser &attrib) {
+  auto attrib_map = attrib[1];
+
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::HlAttrDefine;
+  auto &e = record.hl_attr_define;
+  e.id = attrib[0].get_number<int>();
+
+  const auto GetColor = [&](const char *name) {
+    auto color_node = attrib_map[name];
+    if (color_node.is_number()) {
+      return color_node.get_number<uint32_t>();
+    } else {
+      return Nvim::DEFAULT_COLOR;
+    }
+  };
+  e.foreground = GetColor("foreground");
+  e.background = GetColor("background");
+  e.special = GetColor("special");
+
+  e.flags_set = 0;
+  e.flags_clear = 0;
+  const auto GetFlag = [&](const char *flag_name,
+                           Nvim::HighlightAttributeFlags flag) {
+    auto flag_node = attrib_map[flag_name];
+    if (flag_node.is_bool()) {
+      if (flag_node.get_bool()) {
+        e.flags_set |= flag;
       } else {
-        *color = Nvim::DEFAULT_COLOR;
+        e.flags_clear |= flag;
       }
-    };
-    SetColor("foreground", &grid->hl(attrib_index).foreground);
-    SetColor("background", &grid->hl(attrib_index).background);
-    SetColor("special", &grid->hl(attrib_index).special);
-
-    const auto SetFlag = [&](const char *flag_name,
-                             Nvim::HighlightAttributeFlags flag) {
-      auto flag_node = attrib_map[flag_name];
-      if (flag_node.is_bool()) {
-        if (flag_node.get_bool()) {
-          grid->hl(attrib_index).flags |= flag;
-        } else {
-          grid->hl(attrib_index).flags &= ~flag;
-        }
-      }
-    };
-    SetFlag("reverse", Nvim::HL_ATTRIB_REVERSE);
-    SetFlag("italic", Nvim::HL_ATTRIB_ITALIC);
-    SetFlag("bold", Nvim::HL_ATTRIB_BOLD);
-    SetFlag("strikethrough", Nvim::HL_ATTRIB_STRIKETHROUGH);
-    SetFlag("underline", Nvim::HL_ATTRIB_UNDERLINE);
-    SetFlag("undercurl", Nvim::HL_ATTRIB_UNDERCURL);
-  }
+    }
+  };
+  GetFlag("reverse", Nvim::HL_ATTRIB_REVERSE);
+  GetFlag("italic", Nvim::HL_ATTRIB_ITALIC);
+  GetFlag("bold", Nvim::HL_ATTRIB_BOLD);
+  GetFlag("strikethrough", Nvim::HL_ATTRIB_STRIKETHROUGH);
+  GetFlag("underline", Nvim::HL_ATTRIB_UNDERLINE);
+  GetFlag("undercurl", Nvim::HL_ATTRIB_UNDERCURL);
+
+  _batch.push_back(record);
 }
 
 // ["grid_line",[1,50,193,[[" ",1]]],[1,49,193,[["4",218],["%"],[" "],["
 // ",215,2],["2"],["9"],[":"],["0"]]]]
-void NvimRedraw::DrawGridLines(Nvim::Grid *grid, NvimRenderer *renderer,
-                               const msgpackpp::parser &grid_lines) {
-  int grid_size = grid->Count();
-  size_t line_count = grid_lines.count();
-  for (size_t i = 1; i < line_count; ++i) {
-    auto grid_line = grid_lines[i];
-
-    int row = grid_line[1].get_number<int>();
-    int col_start = grid_line[2].get_number<int>();
-
-    auto cells_array = grid_line[3];
-    size_t cells_array_length = cells_array.count();
-
-    int col_offset = col_start;
-    int hl_attrib_id = 0;
-    for (size_t j = 0; j < cells_array_length; ++j) {
-      auto cells = cells_array[j];
-      size_t cells_length = cells.count();
-
-      auto text = cells[0];
-      auto str = text.get_string();
-      // int strlen = static_cast<int>(mpack_node_strlen(text));
-      if (cells_length > 1) {
-        hl_attrib_id = cells[1].get_number<int>();
+Nvim::GridLineEvent Nvim::DecodeGridLine(const msgpackpp::parser &grid_line,
+                                         Arena &arena, bool ascii_runs) {
+  auto cells_array = grid_line[3];
+  size_t cells_array_length = cells_array.count();
+  auto decoded = arena.Allocate<Nvim::GridLineCell>(cells_array_length);
+  // ascii runs of this line, back to back
+  auto ascii = arena.Allocate<char>(cells_array_length);
+  size_t ascii_size = 0;
+  size_t decoded_count = 0;
+  // walk the cells in order. indexing a msgpack array scans from its head
+  auto cells = cells_array.first_array_item().value;
+  for (size_t j = 0; j < cells_array_length; ++j, cells = cells.next()) {
+    size_t cells_length = cells.count();
+    auto text = cells[0].get_string();
+    int hl_attrib_id = cells_length > 1 ? cells[1].get_number<int>() : -1;
+    int repeat = cells_length > 2 ? cells[2].get_number<int>() : 1;
+
+    if (ascii_runs && text.size() == 1 &&
+        static_cast<uint8_t>(text[0]) < 0x80 && repeat == 1) {
+      auto last = decoded_count ? &decoded[decoded_count - 1] : nullptr;
+      ascii[ascii_size] = text[0];
+      if (last && last->ascii_run && hl_attrib_id < 0) {
+        // extend. the run ends right before this byte
+        last->text = {last->text.data(), last->text.size() + 1};
+      } else {
+        decoded[decoded_count++] = {{&ascii[ascii_size], 1}, hl_attrib_id, 1,
+                                    true};
       }
+      ++ascii_size;
+      continue;
+    }
 
-      // Right part of double-width char is the empty string, thus
-      // if the next cell array contains the empty string, we can
-      // process the current string as a double-width char and
-      // proceed
-      if (j < (cells_array_length - 1) &&
-          cells_array[j + 1][0].get_string().size() == 0) {
-        int offset = row * grid->Cols() + col_offset;
-        grid->Props()[offset].is_wide_char = true;
-        grid->Props()[offset].hl_attrib_id = hl_attrib_id;
-        grid->Props()[offset + 1].hl_attrib_id = hl_attrib_id;
-
-        int wstrlen =
-            MultiByteToWideChar(CP_UTF8, 0, str.data(), str.size(),
-                                &grid->Chars()[offset], grid_size - offset);
-        assert(wstrlen == 1 || wstrlen == 2);
-
-        if (wstrlen == 1) {
-          grid->Chars()[offset + 1] = L'\0';
-        }
-
-        col_offset += 2;
-        continue;
+    if (text.empty() && decoded_count) {
+      // right half of a wide char. the left half must be its own cell
+      auto &last = decoded[decoded_count - 1];
+      if (last.ascii_run && last.text.size() > 1) {
+        auto split = last.text.size() - 1;
+        decoded[decoded_count++] = {last.text.substr(split), -1, 1, true};
+        last.text = last.text.substr(0, split);
       }
+    }
+    decoded[decoded_count++] = {::CopyString(arena, text), hl_attrib_id,
+                                repeat, false};
+  }
 
-      if (strlen == 0) {
-        continue;
-      }
+  return {
+      grid_line[0].get_number<int>(),
+      grid_line[1].get_number<int>(),
+      grid_line[2].get_number<int>(),
+      decoded,
+      static_cast<uint32_t>(decoded_count),
+  };
+}
 
-      int repeat = 1;
-      if (cells_length > 2) {
-        repeat = cells[2].get_number<int>();
-      }
+void NvimRedraw::DecodeGridLine(const msgpackpp::parser &grid_line) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::GridLine;
+  record.grid_line = Nvim::DecodeGridLine(grid_line, _arena);
+  _batch.push_back(record);
+}
 
-      int offset = row * grid->Cols() + col_offset;
-      int wstrlen = 0;
-      for (int k = 0; k < repeat; ++k) {
-        int idx = offset + (k * wstrlen);
-        wstrlen = MultiByteToWideChar(CP_UTF8, 0, str.data(), str.size(),
-                                      &grid->Chars()[idx], grid_size - idx);
-      }
+// ["grid_scroll",[1,0,44,0,190,1,0]]
+void NvimRedraw::DecodeScrollRegion(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::GridScroll;
+  record.grid_scroll = {
+      params[0].get_number<int>(), params[1].get_number<int>(),
+      params[2].get_number<int>(), params[3].get_number<int>(),
+      params[4].get_number<int>(), params[5].get_number<int>(),
+      params[6].get_number<int>(),
+  };
+  NVIM_TRACE(Nvim::TraceEvent::GridScroll, record.grid_scroll.top,
+             record.grid_scroll.bottom, record.grid_scroll.rows);
+  _batch.push_back(record);
+}
+
+// ["win_pos",[2,{win},0,0,80,20]]
+void NvimRedraw::DecodeWinPos(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::WinPos;
+  record.win_pos = {
+      params[0].get_number<int>(),
+      params[2].get_number<int>(),
+      params[3].get_number<int>(),
+  };
+  _batch.push_back(record);
+}
+
+// ["win_float_pos",[4,{win},"NW",2,1.0,0.0,true,50]]
+void NvimRedraw::DecodeWinFloatPos(const msgpackpp::parser &params) {
+  auto anchor = params[2].get_string();
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::WinFloatPos;
+  record.win_float_pos = {
+      params[0].get_number<int>(),
+      anchor == "NE"   ? Nvim::FloatAnchor::NE
+      : anchor == "SW" ? Nvim::FloatAnchor::SW
+      : anchor == "SE" ? Nvim::FloatAnchor::SE
+                       : Nvim::FloatAnchor::NW,
+      params[3].get_number<int>(),
+      params[4].get_number<float>(),
+      params[5].get_number<float>(),
+      // zindex is new in nvim 0.6
+      params.count() > 7 ? params[7].get_number<int>()
+                         : Nvim::DEFAULT_FLOAT_ZINDEX,
+  };
+  _batch.push_back(record);
+}
+
+// ["win_hide",[2]], ["win_close",[2]], ["grid_destroy",[2]]
+template <Nvim::RedrawEvent E>
+void NvimRedraw::DecodeWinHide(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = E;
+  record.win_hide = {params[0].get_number<int>()};
+  _batch.push_back(record);
+}
+
+// ["msg_set_pos",[3,40,false,"-"]]
+void NvimRedraw::DecodeMsgSetPos(const msgpackpp::parser &params) {
+  Nvim::RedrawRecord record;
+  record.type = Nvim::RedrawEvent::MsgSetPos;
+  record.msg_set_pos = {params[0].get_number<int>(),
+                        params[1].get_number<int>()};
+  _batch.push_back(record);
+}
+
+//
+// apply
+//
+
+void NvimRedraw::Apply(Nvim::Grid *grid, NvimRenderer *renderer) {
+  _flush_records += _batch.size();
+
+  // grid is the global grid. window grids are looked up by the event's id
+  for (auto &record : _batch) {
+    switch (record.type) {
+    case Nvim::RedrawEvent::OptionSet:
+      SetGuiFont(renderer, std::string_view(record.option_set.guifont,
+                                            record.option_set.guifont_size));
+      break;
+    case Nvim::RedrawEvent::GridResize:
+      UpdateGridSize(GetGrid(grid, record.grid_resize.grid),
+                     record.grid_resize);
+      break;
+    case Nvim::RedrawEvent::GridClear:
+      ClearGrid(GetGrid(grid, record.grid_clear.grid));
+      break;
+    case Nvim::RedrawEvent::DefaultColorsSet:
+      UpdateDefaultColors(grid, record.default_colors_set);
+      break;
+    case Nvim::RedrawEvent::HlAttrDefine:
+      UpdateHighlightAttributes(grid, record.hl_attr_define);
+      break;
+    case Nvim::RedrawEvent::GridLine:
+      DrawGridLine(GetGrid(grid, record.grid_line.grid), record.grid_line);
+      break;
+    case Nvim::RedrawEvent::GridCursorGoto:
+      UpdateCursorPos(grid, record.grid_cursor_goto);
+      break;
+    case Nvim::RedrawEvent::ModeInfoSet:
+      UpdateCursorModeInfos(grid, record.mode_info_set);
+      break;
+    case Nvim::RedrawEvent::ModeChange:
+      UpdateCursorMode(CursorGrid(grid), record.mode_change);
+      break;
+    case Nvim::RedrawEvent::BusyStart:
+      BusyStart(CursorGrid(grid));
+      break;
+    case Nvim::RedrawEvent::BusyStop:
+      this->_ui_busy = false;
+      break;
+    case Nvim::RedrawEvent::GridScroll:
+      ScrollRegion(GetGrid(grid, record.grid_scroll.grid), renderer,
+                   record.grid_scroll);
+      break;
+    case Nvim::RedrawEvent::Flush:
+      Flush(grid, renderer);
+      break;
+    case Nvim::RedrawEvent::WinPos:
+      UpdateWinPos(grid, record.win_pos);
+      break;
+    case Nvim::RedrawEvent::WinFloatPos:
+      UpdateWinFloatPos(grid, record.win_float_pos);
+      break;
+    case Nvim::RedrawEvent::WinHide:
+    case Nvim::RedrawEvent::WinClose:
+      HideWin(grid, record.win_hide);
+      break;
+    case Nvim::RedrawEvent::GridDestroy:
+      DestroyGrid(grid, renderer, record.win_hide);
+      break;
+    case Nvim::RedrawEvent::MsgSetPos:
+      UpdateMsgPos(grid, record.msg_set_pos);
+      break;
+    default:
+      break;
+    }
+  }
+
+  _batch.clear();
+  // nothing decoded outlives the batch
+  _arena.Reset();
+}
+
+Nvim::Grid *NvimRedraw::GetGrid(Nvim::Grid *global, int id) {
+  if (id == global->Id()) {
+    return global;
+  }
+  auto &grid = _grids[id];
+  if (!grid) {
+    grid = std::make_unique<Nvim::Grid>(id, *global);
+    _grid_order.push_back(grid.get());
+  }
+  return grid.get();
+}
+
+Nvim::Grid *NvimRedraw::FindGrid(Nvim::Grid *global, int id) {
+  if (id == global->Id()) {
+    return global;
+  }
+  auto found = _grids.find(id);
+  return found != _grids.end() ? found->second.get() : nullptr;
+}
+
+Nvim::Grid *NvimRedraw::CursorGrid(Nvim::Grid *global) {
+  auto grid = FindGrid(global, _cursor_grid);
+  return grid ? grid : global;
+}
+
+void NvimRedraw::PlaceGrid(Nvim::Grid *grid,
+                           const Nvim::GridPlacement &placement) {
+  grid->SetPlacement(placement);
+  auto found = std::find(_grid_order.begin(), _grid_order.end(), grid);
+  if (found != _grid_order.end()) {
+    std::rotate(found, found + 1, _grid_order.end());
+  }
+}
+
+std::tuple<int, int, int> NvimRedraw::HitTest(const Nvim::Grid *global,
+                                              int row, int col) const {
+  // the same order as the composite: on a zindex tie the last placed wins
+  const Nvim::Grid *hit = global;
+  for (auto grid : _grid_order) {
+    auto &p = grid->Placement();
+    if (p.visible && p.zindex >= hit->Placement().zindex && row >= p.row &&
+        row < p.row + grid->Rows() && col >= p.col &&
+        col < p.col + grid->Cols()) {
+      hit = grid;
+    }
+  }
+  auto &p = hit->Placement();
+  return {hit->Id(), row - p.row, col - p.col};
+}
+
+void NvimRedraw::DropScrolls(int grid) {
+  _pending_scrolls.erase(std::remove_if(_pending_scrolls.begin(),
+                                        _pending_scrolls.end(),
+                                        [grid](const Nvim::GridScrollEvent &e) {
+                                          return e.grid == grid;
+                                        }),
+                         _pending_scrolls.end());
+}
+
+void NvimRedraw::ClearGrid(Nvim::Grid *grid) {
+  grid->Clear();
+  // every row is redrawn, background included
+  DropScrolls(grid->Id());
+  _stats.rows_marked += grid->Rows();
+  grid->MarkAllDirty();
+}
+
+void NvimRedraw::BusyStart(Nvim::Grid *grid) {
+  this->_ui_busy = true;
+  // Hide cursor while UI is busy
+  if (grid->CursorRow() < grid->Rows()) {
+    MarkLine(grid, grid->CursorRow());
+  }
+}
+
+void NvimRedraw::Flush(Nvim::Grid *grid, NvimRenderer *renderer) {
+  NVIM_TRACE(Nvim::TraceEvent::Flush, _flush_records);
+  _flush_records = 0;
+  ++_stats.flushes;
+  if (_backpressure) {
+    ++_pending_flushes;
+    return;
+  }
+  DrawFrame(grid, renderer);
+}
+
+void NvimRedraw::Render(Nvim::Grid *grid, NvimRenderer *renderer) {
+  if (!_pending_flushes) {
+    return;
+  }
+  _stats.dropped_frames += _pending_flushes - 1;
+  _pending_flushes = 0;
+  DrawFrame(grid, renderer);
+}
+
+void NvimRedraw::DrawFrame(Nvim::Grid *grid, NvimRenderer *renderer) {
+  ++_stats.frames;
+  auto [w, h] = renderer->StartDraw();
+
+  _layers.clear();
+  _layers.push_back(grid);
+  _layers.insert(_layers.end(), _grid_order.begin(), _grid_order.end());
+
+  auto font_size = renderer->FontSize();
+  if (font_size != _font_size) {
+    // layers are rebuilt at the new cell size
+    _font_size = font_size;
+    for (auto layer : _layers) {
+      _stats.rows_marked += layer->Rows();
+      layer->MarkAllDirty();
+    }
+    _pending_scrolls.clear();
+  }
+
+  // before the rows. the dirty marks already moved with them
+  for (auto &e : _pending_scrolls) {
+    if (auto target = FindGrid(grid, e.grid)) {
+      renderer->ScrollRect(target, e.top, e.bottom, e.left, e.right, e.rows);
+    }
+  }
+  _pending_scrolls.clear();
+
+  // each grid into its own layer. hidden ones keep their marks
+  _layers.erase(std::remove_if(_layers.begin(), _layers.end(),
+                               [](const Nvim::Grid *layer) {
+                                 return !layer->Placement().visible;
+                               }),
+                _layers.end());
+  for (auto layer : _layers) {
+    _stats.rows_rendered += layer->TakeDirtyRows(
+        [layer, renderer](int row) { renderer->DrawGridLine(layer, row); });
+  }
+  // the global grid stays at the bottom. ties keep _grid_order
+  std::stable_sort(_layers.begin() + 1, _layers.end(),
+                   [](const Nvim::Grid *l, const Nvim::Grid *r) {
+                     return l->Placement().zindex < r->Placement().zindex;
+                   });
+  renderer->Composite(_layers.data(), _layers.size());
+
+  if (!this->_ui_busy) {
+    renderer->DrawCursor(CursorGrid(grid));
+  }
+  renderer->DrawBorderRectangles(grid, w, h);
+  renderer->FinishDraw();
+}
+
+void NvimRedraw::MarkLine(Nvim::Grid *grid, int row) {
+  ++_stats.rows_marked;
+  grid->MarkDirty(row);
+}
+
+void NvimRedraw::MarkLines(Nvim::Grid *grid, int first, int last) {
+  first = std::max(first, 0);
+  last = std::min(last, grid->Rows());
+  for (int row = first; row < last; ++row) {
+    MarkLine(grid, row);
+  }
+}
+
+void NvimRedraw::SetGuiFont(NvimRenderer *renderer, std::string_view guifont) {
+  // option_set repeats every option on attach. skip the font reload
+  if (guifont.empty() || guifont == _guifont) {
+    return;
+  }
+  _guifont = guifont;
+  if (renderer) {
+    auto [font, size] = ParseGUIFont(_guifont);
+    renderer->SetFont(font, size);
+  }
+}
+
+void NvimRedraw::UpdateGridSize(Nvim::Grid *grid,
+                                const Nvim::GridResizeEvent &e) {
+  if (grid->RowsCols(e.rows, e.cols)) {
+    // every row is redrawn. old pixels may be out of the new bounds
+    DropScrolls(grid->Id());
+  }
+  if (grid->Id() == Nvim::GLOBAL_GRID) {
+    _sizing = false;
+  }
+}
+
+void NvimRedraw::UpdateWinPos(Nvim::Grid *global, const Nvim::WinPosEvent &e) {
+  // a window moves as a whole layer. nothing is redrawn
+  PlaceGrid(GetGrid(global, e.grid), {e.row, e.col, 0, true});
+}
+
+void NvimRedraw::UpdateWinFloatPos(Nvim::Grid *global,
+                                   const Nvim::WinFloatPosEvent &e) {
+  auto grid = GetGrid(global, e.grid);
+  auto anchor_grid = FindGrid(global, e.anchor_grid);
+  auto &anchor = anchor_grid ? anchor_grid->Placement() : global->Placement();
+  int row = anchor.row + static_cast<int>(e.anchor_row);
+  int col = anchor.col + static_cast<int>(e.anchor_col);
+  if (e.anchor == Nvim::FloatAnchor::SW || e.anchor == Nvim::FloatAnchor::SE) {
+    row -= grid->Rows();
+  }
+  if (e.anchor == Nvim::FloatAnchor::NE || e.anchor == Nvim::FloatAnchor::SE) {
+    col -= grid->Cols();
+  }
+  PlaceGrid(grid, {std::max(row, 0), std::max(col, 0), e.zindex, true});
+}
+
+void NvimRedraw::HideWin(Nvim::Grid *global, const Nvim::WinHideEvent &e) {
+  if (auto grid = FindGrid(global, e.grid)) {
+    auto placement = grid->Placement();
+    placement.visible = false;
+    grid->SetPlacement(placement);
+  }
+}
+
+void NvimRedraw::DestroyGrid(Nvim::Grid *global, NvimRenderer *renderer,
+                             const Nvim::WinHideEvent &e) {
+  auto found = _grids.find(e.grid);
+  if (found == _grids.end()) {
+    return;
+  }
+  if (renderer) {
+    renderer->ReleaseGrid(found->second.get());
+  }
+  DropScrolls(e.grid);
+  if (_cursor_grid == e.grid) {
+    _cursor_grid = global->Id();
+  }
+  _grid_order.erase(
+      std::find(_grid_order.begin(), _grid_order.end(), found->second.get()));
+  _grids.erase(found);
+}
+
+void NvimRedraw::UpdateMsgPos(Nvim::Grid *global,
+                              const Nvim::MsgSetPosEvent &e) {
+  PlaceGrid(GetGrid(global, e.grid), {e.row, 0, Nvim::MSG_ZINDEX, true});
+}
+
+void NvimRedraw::UpdateCursorPos(Nvim::Grid *grid,
+                                 const Nvim::GridCursorGotoEvent &e) {
+  // If the old cursor position is still within the row
+  // bounds, redraw the line to get rid of the cursor
+  auto old_grid = CursorGrid(grid);
+  if (old_grid->CursorRow() < old_grid->Rows()) {
+    MarkLine(old_grid, old_grid->CursorRow());
+  }
+  _cursor_grid = e.grid;
+  GetGrid(grid, e.grid)->SetCursor(e.row, e.col);
+}
+
+void NvimRedraw::UpdateCursorModeInfos(Nvim::Grid *grid,
+                                       const Nvim::ModeInfoSetEvent &e) {
+  for (uint32_t i = 0; i < e.count; ++i) {
+    grid->SetCursorShape(i, e.infos[i].shape);
+    grid->SetCursorModeHighlightAttribute(i, e.infos[i].attr_id);
+  }
+}
+
+void NvimRedraw::UpdateCursorMode(Nvim::Grid *grid,
+                                  const Nvim::ModeChangeEvent &e) {
+  // Redraw cursor if its inside the bounds
+  if (grid->CursorRow() < grid->Rows()) {
+    MarkLine(grid, grid->CursorRow());
+  }
+  grid->SetCursorModeInfo(e.mode_idx);
+}
+
+void NvimRedraw::UpdateDefaultColors(Nvim::Grid *grid,
+                                     const Nvim::DefaultColorsSetEvent &e) {
+  // Default colors are highlight id 0
+  grid->SetDefaultColors(e.foreground, e.background, e.special);
+}
 
-      int wstrlen_with_repetitions = wstrlen * repeat;
-      for (int k = 0; k < wstrlen_with_repetitions; ++k) {
-        grid->Props()[offset + k].hl_attrib_id = hl_attrib_id;
-        grid->Props()[offset + k].is_wide_char = false;
+void NvimRedraw::UpdateHighlightAttributes(Nvim::Grid *grid,
+                                           const Nvim::HlAttrDefineEvent &e) {
+  if (e.id <= 0 || e.id >= static_cast<int>(Nvim::MAX_HIGHLIGHT_ATTRIBS)) {
+    return;
+  }
+  auto hl = grid->hl(e.id);
+  hl.foreground = e.foreground;
+  hl.background = e.background;
+  hl.special = e.special;
+  hl.flags = (hl.flags | e.flags_set) & ~e.flags_clear;
+  grid->SetHighlightAttribute(e.id, hl);
+}
+
+// one grid_line cell text as a grid cell
+static Nvim::Cell ToCell(Nvim::Grid *grid, std::string_view text) {
+  uint32_t codepoints[Nvim::MAX_CLUSTER_CODEPOINTS];
+  auto count = Nvim::Utf8ToCodepoints(text.data(), text.size(), codepoints,
+                                      Nvim::MAX_CLUSTER_CODEPOINTS);
+  return grid->MakeCell(codepoints, count);
+}
+
+bool Nvim::WriteGridLine(Grid *grid, const GridLineEvent &e) {
+  // a window grid is 0x0 until its grid_resize
+  if (e.row < 0 || e.row >= grid->Rows() || e.col_start < 0 ||
+      e.col_start >= grid->Cols()) {
+    return false;
+  }
+  int cols = grid->Cols();
+  int row = e.row;
+  auto cells = grid->RowCells(row);
+  auto props = grid->RowProps(row);
+  int col_offset = e.col_start;
+  int hl_attrib_id = 0;
+  for (uint32_t j = 0; j < e.cell_count && col_offset < cols; ++j) {
+    auto &cell = e.cells[j];
+    auto str = cell.text;
+    if (cell.hl_attrib_id >= 0) {
+      hl_attrib_id = cell.hl_attrib_id;
+    }
+
+    // Right part of double-width char is the empty string, thus
+    // if the next cell array contains the empty string, we can
+    // process the current string as a double-width char and
+    // proceed
+    if (j < (e.cell_count - 1) && e.cells[j + 1].text.empty()) {
+      int offset = col_offset;
+      cells[offset] = ToCell(grid, str);
+      props[offset].is_wide_char = true;
+      props[offset].hl_attrib_id = hl_attrib_id;
+      if (offset + 1 < cols) {
+        cells[offset + 1] = 0;
+        props[offset + 1].is_wide_char = false;
+        props[offset + 1].hl_attrib_id = hl_attrib_id;
       }
 
-      col_offset += wstrlen_with_repetitions;
+      col_offset += 2;
+      continue;
+    }
+
+    if (str.empty()) {
+      continue;
     }
 
-    renderer->DrawGridLine(grid, row);
+    if (cell.ascii_run) {
+      int count = std::min(static_cast<int>(str.size()), cols - col_offset);
+      Nvim::WidenAscii(str.data(), count, &cells[col_offset]);
+      Nvim::CellProperty prop = {static_cast<uint16_t>(hl_attrib_id), false};
+      std::fill_n(&props[col_offset], count, prop);
+      col_offset += count;
+      continue;
+    }
+
+    // decode the glyph once, then fill. blank tails come as [" ", hl, 180]
+    int offset = col_offset;
+    int repeat = std::min(cell.repeat, cols - offset);
+    std::fill_n(&cells[offset], repeat, ToCell(grid, str));
+    std::fill_n(&props[offset], repeat,
+                Nvim::CellProperty{static_cast<uint16_t>(hl_attrib_id), false});
+
+    col_offset += repeat;
   }
+  return true;
 }
 
-void NvimRedraw::ScrollRegion(Nvim::Grid *grid, NvimRenderer *renderer,
-                              const msgpackpp::parser &scroll_region) {
-  PLOGD << scroll_region;
-  auto scroll_region_params = scroll_region[1];
-  int64_t top = scroll_region_params[1].get_number<int>();
-  int64_t bottom = scroll_region_params[2].get_number<int>();
-  int64_t left = scroll_region_params[3].get_number<int>();
-  int64_t right = scroll_region_params[4].get_number<int>();
-  int64_t rows = scroll_region_params[5].get_number<int>();
-  int64_t cols = scroll_region_params[6].get_number<int>();
+void NvimRedraw::DrawGridLine(Nvim::Grid *grid, const Nvim::GridLineEvent &e) {
+  if (Nvim::WriteGridLine(grid, e)) {
+    MarkLine(grid, e.row);
+  }
+}
 
+void NvimRedraw::ScrollRegion(Nvim::Grid *grid, NvimRenderer *renderer,
+                              const Nvim::GridScrollEvent &e) {
   // Currently nvim does not support horizontal scrolling,
   // the parameter is reserved for later use
-  assert(cols == 0);
-
-  // This part is slightly cryptic, basically we're just
-  // iterating from top to bottom or vice versa depending on scroll
-  // direction.
-  bool scrolling_down = rows > 0;
-  int64_t start_row = scrolling_down ? top : bottom - 1;
-  int64_t end_row = scrolling_down ? bottom - 1 : top;
-  int64_t increment = scrolling_down ? 1 : -1;
-
-  for (int64_t i = start_row; scrolling_down ? i <= end_row : i >= end_row;
-       i += increment) {
-    // Clip anything outside the scroll region
-    int64_t target_row = i - rows;
-    if (target_row < top || target_row >= bottom) {
-      continue;
-    }
+  assert(e.cols == 0);
 
-    grid->LineCopy(left, right, i, target_row);
+  // full width scrolls only rotate the grid's row index
+  if (!grid->Scroll(e.top, e.bottom, e.left, e.right, e.rows)) {
+    // nothing moved, so there is nothing to blit or redraw
+    return;
+  }
 
-    // Sadly I have given up on making use of IDXGISwapChain1::Present1
-    // scroll_rects or bitmap copies. The former seems insufficient for
-    // nvim since it can require multiple scrolls per frame, the latter
-    // I can't seem to make work with the FLIP_SEQUENTIAL swapchain
-    // model. Thus we fall back to drawing the appropriate scrolled
-    // grid lines
-    renderer->DrawGridLine(grid, target_row);
+  if (renderer && renderer->CanScrollRect()) {
+    // move the pixels at the next frame and draw only the exposed rows
+    _pending_scrolls.push_back(e);
+    ++_stats.scroll_blits;
+    grid->ScrollDirty(e.top, e.bottom, e.left == 0 && e.right == grid->Cols(),
+                      e.rows);
+    int first = e.rows > 0 ? std::max(e.top, e.bottom - e.rows) : e.top;
+    int last = e.rows > 0 ? e.bottom : std::min(e.bottom, e.top - e.rows);
+    MarkLines(grid, first, last);
+  } else {
+    // Without ScrollRect every scrolled row is redrawn
+    int first = std::max(e.top, e.top - e.rows);
+    int last = std::min(e.bottom, e.bottom - e.rows);
+    MarkLines(grid, first, last);
   }
 
   // Redraw the line which the cursor has moved to, as it is no
   // longer guaranteed that the cursor is still there
-  int cursor_row = grid->CursorRow() - rows;
-  if (cursor_row >= 0 && cursor_row < grid->Rows()) {
-    renderer->DrawGridLine(grid, cursor_row);
+  int cursor_row = grid->CursorRow() - e.rows;
+  if (grid->Id() == _cursor_grid && cursor_row >= 0 &&
+      cursor_row < grid->Rows()) {
+    MarkLine(grid, cursor_row);
   }
 }
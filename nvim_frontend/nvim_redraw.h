@@ -1,6 +1,14 @@
 #pragma once
+#include "nvim_arena.h"
+#include "nvim_redraw_event.h"
+#include "nvim_stats.h"
+#include <stdint.h>
+#include <string>
 #include <string_view>
+#include <memory>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace msgpackpp {
 class parser;
@@ -8,34 +16,157 @@ class parser;
 
 namespace Nvim {
 class Grid;
-}
 
+// The grid_line stages of NvimRedraw, free so that bench/grid_line_bench can
+// compare the ascii run path with the per cell one.
+// one [grid, row, col_start, cells] tuple. cells and strings go into arena.
+// ascii_runs: merge single byte ascii cells into runs. see GridLineCell
+GridLineEvent DecodeGridLine(const msgpackpp::parser &grid_line, Arena &arena,
+                             bool ascii_runs = true);
+// writes the cells into their row. the row is not marked dirty.
+// false if the row or col_start is outside the grid
+bool WriteGridLine(Grid *grid, const GridLineEvent &e);
+} // namespace Nvim
+
+// Redraw events go through two stages.
+// Decode turns msgpack into typed records (nvim_redraw_event.h) in a flat
+// per batch buffer. At flush, Apply runs the records against the grids and
+// draws. A batch that outgrows MAX_PENDING_BYTES is applied early, without
+// drawing. Neither stage looks at the other's data structures.
 struct NvimRedraw {
   bool _ui_busy = false;
 
+  // params: [event, event, ...]
   void Dispatch(Nvim::Grid *grid, class NvimRenderer *renderer,
                 const msgpackpp::parser &params);
+  // one ["grid_line", [...], ...]
+  void DispatchEvent(Nvim::Grid *grid, class NvimRenderer *renderer,
+                     const msgpackpp::parser &event);
+  // one [...] of an event, as soon as it is received. name is the event's.
+  // see NvimRpc::add_stream_proc
+  void DispatchArgs(Nvim::Grid *grid, class NvimRenderer *renderer,
+                    const msgpackpp::parser &name,
+                    const msgpackpp::parser &args);
+  void DispatchArgs(Nvim::Grid *grid, class NvimRenderer *renderer,
+                    Nvim::RedrawEvent event, const msgpackpp::parser &args);
   static std::tuple<std::string_view, float>
   ParseGUIFont(std::string_view gui_font);
 
+  // append the records of one event to the batch
+  void Decode(const msgpackpp::parser &event);
+  // append the record of one argument tuple of event
+  void DecodeArgs(Nvim::RedrawEvent event, const msgpackpp::parser &args);
+  // apply and clear the batch
+  void Apply(Nvim::Grid *grid, class NvimRenderer *renderer);
+
+  // last guifont reported by nvim. empty until known
+  std::string _guifont;
+  const std::string &GuiFont() const { return _guifont; }
+  // renderer is nullptr before AttachUI. only remembered then
+  void SetGuiFont(class NvimRenderer *renderer, std::string_view guifont);
+
   bool _sizing = false;
   bool Sizing() const { return _sizing; }
   void SetSizing() { _sizing = true; }
 
+  // ext_multigrid. the topmost grid at a cell of the global grid, and the
+  // cell within it: {grid, row, col}. for nvim_input_mouse
+  std::tuple<int, int, int> HitTest(const Nvim::Grid *global, int row,
+                                    int col) const;
+
+  // Apply only updates the grid and marks rows. Without backpressure flush
+  // draws them. With it Render draws the newest state once, so flushes
+  // received within one display frame collapse into a single frame.
+  void SetBackpressure(bool enable) { _backpressure = enable; }
+  // call once per display frame. no-op if nothing was flushed
+  void Render(Nvim::Grid *grid, class NvimRenderer *renderer);
+  Nvim::RedrawStats Stats() const {
+    auto stats = _stats;
+    stats.arena_heap_allocations = _arena.HeapAllocations();
+    return stats;
+  }
+
 private:
-  void SetGuiOptions(class NvimRenderer *renderer,
-                     const msgpackpp::parser &option_set);
-  void UpdateGridSize(Nvim::Grid *grid, const msgpackpp::parser &grid_resize);
-  void UpdateCursorPos(Nvim::Grid *grid, const msgpackpp::parser &cursor_goto);
-  void UpdateCursorModeInfos(Nvim::Grid *grid,
-                             const msgpackpp::parser &mode_info_set_params);
-  void UpdateCursorMode(Nvim::Grid *grid, const msgpackpp::parser &mode_change);
+  bool _backpressure = false;
+  // dirty rows are kept by the grid. see Nvim::Grid::MarkDirty
+  int _pending_flushes = 0;
+  // records applied since the last flush. for the trace
+  size_t _flush_records = 0;
+
+  // ext_multigrid. window grids by id. the global grid is passed in
+  std::unordered_map<int, std::unique_ptr<Nvim::Grid>> _grids;
+  // _grids, last placed last. breaks zindex ties in DrawFrame and HitTest
+  std::vector<Nvim::Grid *> _grid_order;
+  int _cursor_grid = Nvim::GLOBAL_GRID;
+  // visible grids of the frame being drawn, in composite order
+  std::vector<Nvim::Grid *> _layers;
+  // layers are redrawn when the cell size changes
+  std::tuple<float, float> _font_size = {};
+  // blits for the next frame, in order. see NvimRenderer::ScrollRect
+  std::vector<Nvim::GridScrollEvent> _pending_scrolls;
+  Nvim::RedrawStats _stats = {};
+
+  // a batch bigger than this is applied before its flush arrives
+  static constexpr size_t MAX_PENDING_BYTES = 4 * Nvim::Arena::BLOCK_SIZE;
+  // capacity is kept across batches
+  std::vector<Nvim::RedrawRecord> _batch;
+  // cells and strings of _batch. reset with it
+  Nvim::Arena _arena;
+
+  std::string_view CopyString(std::string_view src);
+  // appliers only mark rows. each dirty row is drawn once per frame
+  void MarkLine(Nvim::Grid *grid, int row);
+  // [first, last), clamped to the grid
+  void MarkLines(Nvim::Grid *grid, int first, int last);
+  void DrawFrame(Nvim::Grid *grid, NvimRenderer *renderer);
+  // creates a window grid on first use
+  Nvim::Grid *GetGrid(Nvim::Grid *global, int id);
+  // nullptr if unknown
+  Nvim::Grid *FindGrid(Nvim::Grid *global, int id);
+  Nvim::Grid *CursorGrid(Nvim::Grid *global);
+  // moves grid to the top of its zindex. see _grid_order
+  void PlaceGrid(Nvim::Grid *grid, const Nvim::GridPlacement &placement);
+  void DropScrolls(int grid);
+
+  // decoders. one argument tuple each. see DecodeArgs
+  void DecodeUnknown(const msgpackpp::parser &args);
+  void DecodeOptionSet(const msgpackpp::parser &option);
+  void DecodeGridResize(const msgpackpp::parser &params);
+  void DecodeGridClear(const msgpackpp::parser &params);
+  void DecodeDefaultColors(const msgpackpp::parser &color_arr);
+  void DecodeHighlightAttributes(const msgpackpp::parser &attrib);
+  void DecodeGridLine(const msgpackpp::parser &grid_line);
+  void DecodeCursorPos(const msgpackpp::parser &params);
+  void DecodeCursorModeInfos(const msgpackpp::parser &mode_info_params);
+  void DecodeCursorMode(const msgpackpp::parser &params);
+  template <Nvim::RedrawEvent E>
+  void DecodeNoArgs(const msgpackpp::parser &args);
+  void DecodeScrollRegion(const msgpackpp::parser &params);
+  void DecodeWinPos(const msgpackpp::parser &params);
+  void DecodeWinFloatPos(const msgpackpp::parser &params);
+  template <Nvim::RedrawEvent E>
+  void DecodeWinHide(const msgpackpp::parser &params);
+  void DecodeMsgSetPos(const msgpackpp::parser &params);
+
+  // appliers. see Apply
+  void UpdateGridSize(Nvim::Grid *grid, const Nvim::GridResizeEvent &e);
+  void ClearGrid(Nvim::Grid *grid);
+  void UpdateCursorPos(Nvim::Grid *grid, const Nvim::GridCursorGotoEvent &e);
+  void UpdateCursorModeInfos(Nvim::Grid *grid, const Nvim::ModeInfoSetEvent &e);
+  void UpdateCursorMode(Nvim::Grid *grid, const Nvim::ModeChangeEvent &e);
   void UpdateDefaultColors(Nvim::Grid *grid,
-                           const msgpackpp::parser &default_colors);
+                           const Nvim::DefaultColorsSetEvent &e);
   void UpdateHighlightAttributes(Nvim::Grid *grid,
-                                 const msgpackpp::parser &highlight_attribs);
-  void DrawGridLines(Nvim::Grid *grid, NvimRenderer *renderer,
-                     const msgpackpp::parser &grid_lines);
+                                 const Nvim::HlAttrDefineEvent &e);
+  void DrawGridLine(Nvim::Grid *grid, const Nvim::GridLineEvent &e);
   void ScrollRegion(Nvim::Grid *grid, NvimRenderer *renderer,
-                    const msgpackpp::parser &scroll_region);
+                    const Nvim::GridScrollEvent &e);
+  void BusyStart(Nvim::Grid *grid);
+  void Flush(Nvim::Grid *grid, NvimRenderer *renderer);
+  void UpdateWinPos(Nvim::Grid *global, const Nvim::WinPosEvent &e);
+  void UpdateWinFloatPos(Nvim::Grid *global, const Nvim::WinFloatPosEvent &e);
+  void HideWin(Nvim::Grid *global, const Nvim::WinHideEvent &e);
+  void DestroyGrid(Nvim::Grid *global, NvimRenderer *renderer,
+                   const Nvim::WinHideEvent &e);
+  void UpdateMsgPos(Nvim::Grid *global, const Nvim::MsgSetPosEvent &e);
 };
@@ -0,0 +1,264 @@
+#pragma once
+#include "nvim_grid.h"
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+namespace Nvim {
+
+// ui events handled by NvimRedraw
+enum class RedrawEvent : uint8_t {
+  Unknown,
+  OptionSet,
+  GridResize,
+  GridClear,
+  DefaultColorsSet,
+  HlAttrDefine,
+  GridLine,
+  GridCursorGoto,
+  ModeInfoSet,
+  ModeChange,
+  BusyStart,
+  BusyStop,
+  GridScroll,
+  Flush,
+  // ext_multigrid
+  WinPos,
+  WinFloatPos,
+  WinHide,
+  WinClose,
+  GridDestroy,
+  MsgSetPos,
+  Count,
+};
+
+// indexed by RedrawEvent
+constexpr std::string_view REDRAW_EVENT_NAMES[] = {
+    "",
+    "option_set",
+    "grid_resize",
+    "grid_clear",
+    "default_colors_set",
+    "hl_attr_define",
+    "grid_line",
+    "grid_cursor_goto",
+    "mode_info_set",
+    "mode_change",
+    "busy_start",
+    "busy_stop",
+    "grid_scroll",
+    "flush",
+    "win_pos",
+    "win_float_pos",
+    "win_hide",
+    "win_close",
+    "grid_destroy",
+    "msg_set_pos",
+};
+static_assert(sizeof(REDRAW_EVENT_NAMES) / sizeof(REDRAW_EVENT_NAMES[0]) ==
+              static_cast<size_t>(RedrawEvent::Count));
+
+// Perfect hash of the names above, found at compile time. A name is hashed
+// once and checked with one string compare.
+constexpr int REDRAW_EVENT_SLOT_BITS = 6;
+constexpr size_t REDRAW_EVENT_SLOTS = 1 << REDRAW_EVENT_SLOT_BITS;
+
+// The length, the middle byte and the last byte tell the names apart, so the
+// rest is not read. a full byte loop costs more than the if/else chain it
+// replaces. see bench/redraw_dispatch_bench.cpp
+constexpr uint32_t RedrawEventHash(std::string_view name, uint32_t seed) {
+  if (name.empty()) {
+    return 0;
+  }
+  uint32_t key = static_cast<uint32_t>(name.size()) |
+                 static_cast<uint32_t>(static_cast<uint8_t>(name.back())) << 8 |
+                 static_cast<uint32_t>(
+                     static_cast<uint8_t>(name[name.size() / 2]))
+                     << 16;
+  return ((key ^ seed) * 0x9e3779b1u) >> (32 - REDRAW_EVENT_SLOT_BITS);
+}
+
+constexpr bool IsPerfectRedrawEventHash(uint32_t seed) {
+  bool used[REDRAW_EVENT_SLOTS] = {};
+  for (size_t i = 1; i < static_cast<size_t>(RedrawEvent::Count); ++i) {
+    auto slot = RedrawEventHash(REDRAW_EVENT_NAMES[i], seed);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr uint32_t FindRedrawEventSeed() {
+  for (uint32_t seed = 0; seed < 0x10000; ++seed) {
+    if (IsPerfectRedrawEventHash(seed)) {
+      return seed;
+    }
+  }
+  return UINT32_MAX;
+}
+
+constexpr uint32_t REDRAW_EVENT_SEED = FindRedrawEventSeed();
+static_assert(REDRAW_EVENT_SEED != UINT32_MAX,
+              "no perfect hash. increase REDRAW_EVENT_SLOTS");
+
+constexpr std::array<RedrawEvent, REDRAW_EVENT_SLOTS> MakeRedrawEventTable() {
+  std::array<RedrawEvent, REDRAW_EVENT_SLOTS> table{};
+  for (size_t i = 1; i < static_cast<size_t>(RedrawEvent::Count); ++i) {
+    table[RedrawEventHash(REDRAW_EVENT_NAMES[i], REDRAW_EVENT_SEED)] =
+        static_cast<RedrawEvent>(i);
+  }
+  return table;
+}
+
+constexpr std::array<RedrawEvent, REDRAW_EVENT_SLOTS> REDRAW_EVENT_TABLE =
+    MakeRedrawEventTable();
+
+constexpr RedrawEvent ToRedrawEvent(std::string_view name) {
+  auto event = REDRAW_EVENT_TABLE[RedrawEventHash(name, REDRAW_EVENT_SEED)];
+  return REDRAW_EVENT_NAMES[static_cast<size_t>(event)] == name
+             ? event
+             : RedrawEvent::Unknown;
+}
+
+//
+// Decoded events, one per argument tuple. Variable length parts (cells,
+// strings) are copied into the batch arena, so a batch does not point into
+// the receive buffer and can be applied later or elsewhere.
+// see NvimRedraw::Decode and Apply
+//
+
+struct GridLineCell {
+  std::string_view text;
+  // -1: same as the previous cell
+  int hl_attrib_id;
+  int repeat;
+  // text is a run of single byte ascii cells, one byte per cell.
+  // Decode merges them so Apply can widen the run at once
+  bool ascii_run;
+};
+
+struct GridLineEvent {
+  int grid;
+  int row;
+  int col_start;
+  const GridLineCell *cells;
+  uint32_t cell_count;
+};
+
+struct GridScrollEvent {
+  int grid;
+  int top;
+  int bottom;
+  int left;
+  int right;
+  int rows;
+  int cols;
+};
+
+struct GridResizeEvent {
+  int grid;
+  int cols;
+  int rows;
+};
+
+struct GridClearEvent {
+  int grid;
+};
+
+struct GridCursorGotoEvent {
+  int grid;
+  int row;
+  int col;
+};
+
+struct DefaultColorsSetEvent {
+  uint32_t foreground;
+  uint32_t background;
+  uint32_t special;
+};
+
+struct HlAttrDefineEvent {
+  int id;
+  // DEFAULT_COLOR if not given
+  uint32_t foreground;
+  uint32_t background;
+  uint32_t special;
+  // flags not given keep their value
+  uint16_t flags_set;
+  uint16_t flags_clear;
+};
+
+struct ModeInfo {
+  CursorShape shape;
+  int attr_id;
+};
+
+struct ModeInfoSetEvent {
+  const ModeInfo *infos;
+  uint32_t count;
+};
+
+struct ModeChangeEvent {
+  int mode_idx;
+};
+
+struct WinPosEvent {
+  int grid;
+  int row;
+  int col;
+};
+
+enum class FloatAnchor : uint8_t { NW, NE, SW, SE };
+// nvim's defaults
+constexpr int DEFAULT_FLOAT_ZINDEX = 50;
+constexpr int MSG_ZINDEX = 200;
+
+struct WinFloatPosEvent {
+  int grid;
+  FloatAnchor anchor;
+  int anchor_grid;
+  float anchor_row;
+  float anchor_col;
+  int zindex;
+};
+
+// win_hide, win_close and grid_destroy
+struct WinHideEvent {
+  int grid;
+};
+
+struct MsgSetPosEvent {
+  int grid;
+  int row;
+};
+
+// only the options we use
+struct OptionSetEvent {
+  const char *guifont;
+  uint32_t guifont_size;
+};
+
+struct RedrawRecord {
+  RedrawEvent type;
+  union {
+    GridLineEvent grid_line;
+    GridScrollEvent grid_scroll;
+    GridResizeEvent grid_resize;
+    GridClearEvent grid_clear;
+    GridCursorGotoEvent grid_cursor_goto;
+    DefaultColorsSetEvent default_colors_set;
+    HlAttrDefineEvent hl_attr_define;
+    ModeInfoSetEvent mode_info_set;
+    ModeChangeEvent mode_change;
+    OptionSetEvent option_set;
+    WinPosEvent win_pos;
+    WinFloatPosEvent win_float_pos;
+    WinHideEvent win_hide;
+    MsgSetPosEvent msg_set_pos;
+  };
+};
+
+} // namespace Nvim
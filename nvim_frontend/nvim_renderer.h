@@ -1,5 +1,7 @@
 #pragma once
+#include <stddef.h>
 #include <string_view>
+#include <tuple>
 
 namespace Nvim {
 struct HighlightAttribute;
@@ -13,12 +15,23 @@ public:
   virtual void SetFont(std::string_view font, float size) = 0;
   virtual std::tuple<float, float> FontSize() const = 0;
   // render
-  virtual void DrawBackgroundRect(int rows, int cols,
-                                  const Nvim::HighlightAttribute *hl) = 0;
+  // Each grid (ext_multigrid: one per window) is drawn into a layer of its
+  // own. Composite draws the layers to the target in order, at
+  // Grid::Placement(). The cursor and borders are drawn over that
   virtual void DrawGridLine(const Nvim::Grid *grid, int row) = 0;
+  virtual void Composite(const Nvim::Grid *const *grids, size_t count) = 0;
+  // grid_destroy. drop the layer
+  virtual void ReleaseGrid(const Nvim::Grid * /*grid*/) {}
   virtual void DrawCursor(const Nvim::Grid *grid) = 0;
   virtual void DrawBorderRectangles(const Nvim::Grid *grid, int width,
                                     int height) = 0;
   virtual std::tuple<int, int> StartDraw() = 0;
   virtual void FinishDraw() = 0;
+  // optional. a backend that keeps its layers between frames can move the
+  // cells [top, bottom) x [left, right) of a grid by rows (rows > 0: up) and
+  // only the exposed rows are drawn. called between StartDraw and FinishDraw
+  virtual bool CanScrollRect() const { return false; }
+  virtual void ScrollRect(const Nvim::Grid * /*grid*/, int /*top*/,
+                          int /*bottom*/, int /*left*/, int /*right*/,
+                          int /*rows*/) {}
 };
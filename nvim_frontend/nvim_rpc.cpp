@@ -0,0 +1,232 @@
+#include "nvim_rpc.h"
+#include "nvim_msgpack.h"
+#include "nvim_trace.h"
+#include <plog/Log.h>
+
+enum class RpcMessageType {
+  Request = 0,
+  Response = 1,
+  Notification = 2,
+};
+
+// msgpack nil
+constexpr uint8_t NIL = 0xc0;
+
+NvimRpc::~NvimRpc() { _transport.Close(); }
+
+void NvimRpc::attach(const NvimTransport &transport) {
+  _transport = transport;
+  _transport.start_read();
+}
+
+void NvimRpc::add_proc(std::string_view method, const proc_t &proc) {
+  for (auto &[name, p] : _procs) {
+    if (name == method) {
+      p = proc;
+      return;
+    }
+  }
+  _procs.emplace_back(std::string(method), proc);
+}
+
+void NvimRpc::add_stream_proc(std::string_view method,
+                              const stream_proc_t &proc) {
+  for (auto &[name, p] : _stream_procs) {
+    if (name == method) {
+      p = proc;
+      return;
+    }
+  }
+  _stream_procs.emplace_back(std::string(method), proc);
+}
+
+void NvimRpc::write_async(const uint8_t *data, size_t size) {
+  NVIM_TRACE(Nvim::TraceEvent::RpcSend, size);
+  if (_on_send) {
+    _on_send(data, size);
+  }
+  _transport.write_async(data, size);
+}
+
+bool NvimRpc::Process(bool wait) {
+  return _transport.Deliver(
+      [self = this](const uint8_t *data, size_t size) {
+        self->Dispatch(data, size);
+      },
+      [self = this](const uint8_t *data, size_t size) {
+        // apply what has arrived of a big notification
+        self->Stream(data, size);
+      },
+      wait);
+}
+
+// [2, method, [item, item, ...]]
+bool NvimRpc::BeginStream(const uint8_t *data, size_t size) {
+  uint64_t count;
+  size_t pos = Nvim::MsgpackArrayHeader(data, size, &count);
+  if (!pos || count != 3 || pos >= size ||
+      data[pos] != static_cast<uint8_t>(RpcMessageType::Notification)) {
+    return false;
+  }
+  ++pos;
+  auto method_size = Nvim::MsgpackObjectSize(data + pos, size - pos);
+  if (!method_size) {
+    return false;
+  }
+  msgpackpp::parser method(data + pos, static_cast<int>(method_size));
+  if (!method.is_string()) {
+    return false;
+  }
+  pos += method_size;
+  for (size_t i = 0; i < _stream_procs.size(); ++i) {
+    if (_stream_procs[i].first == method.get_string()) {
+      auto header = Nvim::MsgpackArrayHeader(data + pos, size - pos, &count);
+      if (!header) {
+        return false;
+      }
+      _streaming = {};
+      _streaming.proc = static_cast<int>(i);
+      _streaming.pos = pos + header;
+      _streaming.remaining = count;
+      return true;
+    }
+  }
+  return false;
+}
+
+void NvimRpc::Stream(const uint8_t *data, size_t size) {
+  if (_streaming.proc < 0 && !BeginStream(data, size)) {
+    return;
+  }
+  auto &proc = _stream_procs[_streaming.proc].second;
+  auto &s = _streaming;
+  while (s.remaining) {
+    if (!s.name_size) {
+      // [name, args, args, ...]. the header and the name are taken together
+      if (s.pos >= size) {
+        return;
+      }
+      uint64_t count;
+      auto header =
+          Nvim::MsgpackArrayHeader(data + s.pos, size - s.pos, &count);
+      auto head = data[s.pos];
+      if (!header && ((head & 0xf0) == 0x90 || head == 0xdc || head == 0xdd)) {
+        // wait for more bytes
+        return;
+      }
+      if (!header || count == 0) {
+        // not [name, ...]. skip it whole
+        auto item_size = s.scan.Resume(data + s.pos, size - s.pos);
+        if (!item_size) {
+          return;
+        }
+        s.scan = {};
+        s.pos += item_size;
+        --s.remaining;
+        continue;
+      }
+      auto name_size = Nvim::MsgpackObjectSize(data + s.pos + header,
+                                               size - s.pos - header);
+      if (!name_size) {
+        return;
+      }
+      s.name_pos = s.pos + header;
+      s.name_size = name_size;
+      s.pos = s.name_pos + name_size;
+      s.args = count - 1;
+    }
+
+    msgpackpp::parser name(data + s.name_pos, static_cast<int>(s.name_size));
+    while (s.args) {
+      // a big args is scanned once, however many reads it takes
+      auto args_size = s.scan.Resume(data + s.pos, size - s.pos);
+      if (!args_size) {
+        // wait for more bytes
+        return;
+      }
+      s.scan = {};
+      proc(name, msgpackpp::parser(data + s.pos, static_cast<int>(args_size)));
+      s.pos += args_size;
+      --s.args;
+    }
+    s.name_size = 0;
+    --s.remaining;
+  }
+}
+
+void NvimRpc::Dispatch(const uint8_t *data, size_t size) {
+  if (_streaming.proc >= 0 || BeginStream(data, size)) {
+    // the rest of a streamed notification
+    Stream(data, size);
+    _streaming = {};
+    return;
+  }
+
+  msgpackpp::parser msg(data, static_cast<int>(size));
+  switch (static_cast<RpcMessageType>(msg[0].get_number<int>())) {
+  case RpcMessageType::Request: {
+    // [0, msgid, method, params]
+    auto id = msg[1].get_number<uint32_t>();
+    auto method = msg[2].get_string();
+    std::vector<uint8_t> result;
+    for (auto &[name, proc] : _procs) {
+      if (name == method) {
+        result = proc(msg[3]);
+        break;
+      }
+    }
+
+    // [1, msgid, nil, result]
+    msgpackpp::packer packer;
+    packer.pack_array(4);
+    packer << 1 << id;
+    packer.pack_nil();
+    auto response = packer.get_payload();
+    if (result.empty()) {
+      response.push_back(NIL);
+    } else {
+      response.insert(response.end(), result.begin(), result.end());
+    }
+    write_async(response);
+    break;
+  }
+
+  case RpcMessageType::Response: {
+    // [1, msgid, error, result]
+    auto id = msg[1].get_number<uint32_t>();
+    auto found = _requests.find(id);
+    if (found == _requests.end()) {
+      PLOGE << "(rpc) unknown response: " << id;
+      break;
+    }
+    if (!msg[2].is_nil()) {
+      PLOGE << "(rpc) error: " << msg[2];
+    }
+    size_t result_size;
+    auto result = Nvim::MsgpackArrayItem(data, size, 3, &result_size);
+    if (result) {
+      found->second(msg[2], result, result_size);
+    } else {
+      found->second(msg[2], &NIL, 1);
+    }
+    _requests.erase(found);
+    break;
+  }
+
+  case RpcMessageType::Notification: {
+    // [2, method, params]
+    auto method = msg[1].get_string();
+    for (auto &[name, proc] : _procs) {
+      if (name == method) {
+        proc(msg[2]);
+        return;
+      }
+    }
+    break;
+  }
+
+  default:
+    PLOGE << "(rpc) unknown message type";
+    break;
+  }
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "nvim_msgpack.h"
+#include "nvim_transport.h"
+#include <functional>
+#include <future>
+#include <memory>
+#include <msgpackpp/msgpackpp.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// {} as an argument, e.g. the opts of nvim_get_option_value
+struct NvimEmptyMap {};
+inline msgpackpp::packer &operator<<(msgpackpp::packer &packer, NvimEmptyMap) {
+  packer.pack_map(0);
+  return packer;
+}
+
+// msgpack-rpc over NvimTransport. Replaces msgpackpp::rpc_base, which copies
+// every message into its own buffer before parsing. Here messages are parsed
+// where they lie in the NvimRecvBuffer.
+//
+// Not thread safe. Use it from the thread that calls Process.
+class NvimRpc {
+public:
+  // result must be a packed msgpack object (empty => nil)
+  using proc_t =
+      std::function<std::vector<uint8_t>(const msgpackpp::parser &params)>;
+  // For big batches like "redraw", whose params are
+  // [[name, args, args, ...], [name, args, ...], ...].
+  // Called with each args and the name before it as soon as the args are
+  // received, before the rest of the message. So one huge ["grid_line", ...]
+  // is handed out line by line while it is still arriving
+  using stream_proc_t = std::function<void(const msgpackpp::parser &name,
+                                           const msgpackpp::parser &args)>;
+  using on_send_t = std::function<void(const uint8_t *data, size_t size)>;
+  // called from Process. error is nil on success
+  using on_response_t = std::function<void(const msgpackpp::parser &error,
+                                           const msgpackpp::parser &result)>;
+
+  // Messages written in this scope go out in one write.
+  class Batch {
+    NvimRpc &_rpc;
+
+  public:
+    Batch(NvimRpc &rpc) : _rpc(rpc) { _rpc._transport.cork(); }
+    ~Batch() { _rpc._transport.uncork(); }
+    Batch(const Batch &) = delete;
+    Batch &operator=(const Batch &) = delete;
+  };
+
+private:
+  NvimTransport _transport;
+  uint32_t _next_id = 1;
+  // msgid => response handler. result is the packed object
+  using on_raw_response_t = std::function<void(
+      const msgpackpp::parser &error, const uint8_t *result, size_t size)>;
+  std::unordered_map<uint32_t, on_raw_response_t> _requests;
+  std::vector<std::pair<std::string, proc_t>> _procs;
+  std::vector<std::pair<std::string, stream_proc_t>> _stream_procs;
+  on_send_t _on_send;
+
+  // the incomplete head message is a notification to a stream proc.
+  // Offsets are from the message head. the receive buffer may move the
+  // message, but not its content
+  struct Streaming {
+    // index of _stream_procs. -1 if not streaming
+    int proc = -1;
+    // next byte to read
+    size_t pos = 0;
+    // items of params left, the current one included
+    uint64_t remaining = 0;
+    // the current item's name. name_size is 0 between items
+    size_t name_pos = 0;
+    size_t name_size = 0;
+    // args left in the current item
+    uint64_t args = 0;
+    // how far the incomplete object at pos has been scanned
+    Nvim::MsgpackScan scan;
+  };
+  Streaming _streaming;
+
+public:
+  NvimRpc() {}
+  ~NvimRpc();
+  NvimRpc(const NvimRpc &) = delete;
+  NvimRpc &operator=(const NvimRpc &) = delete;
+
+  // start reading
+  void attach(const NvimTransport &transport);
+  void add_proc(std::string_view method, const proc_t &proc);
+  void add_stream_proc(std::string_view method, const stream_proc_t &proc);
+  void set_on_send(const on_send_t &callback) { _on_send = callback; }
+
+  void write_async(const std::vector<uint8_t> &bytes) {
+    write_async(bytes.data(), bytes.size());
+  }
+  // one packed message. copied before return, so a stack buffer is fine
+  void write_async(const uint8_t *data, size_t size);
+  Nvim::WriteStats write_stats() const { return _transport.write_stats(); }
+
+  template <typename... ARGS> void notify(const char *method, ARGS... args) {
+    write_async(msgpackpp::make_rpc_notify(method, args...));
+  }
+
+  // [0, msgid, method, params]
+  // Does not wait. callback is invoked from Process when the response arrives
+  template <typename... ARGS>
+  void request(const char *method, const on_response_t &callback,
+               ARGS... args) {
+    request_raw(
+        method,
+        [callback](const msgpackpp::parser &error, const uint8_t *result,
+                   size_t size) {
+          callback(error, msgpackpp::parser(result, static_cast<int>(size)));
+        },
+        args...);
+  }
+
+  // future of the packed result
+  template <typename... ARGS>
+  std::future<std::vector<uint8_t>> request_async(const char *method,
+                                                  ARGS... args) {
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    auto future = promise->get_future();
+    request_raw(
+        method,
+        [promise](const msgpackpp::parser &, const uint8_t *result,
+                  size_t size) {
+          promise->set_value(std::vector<uint8_t>(result, result + size));
+        },
+        args...);
+    return future;
+  }
+
+  // Dispatch received messages to procs and pending requests.
+  // wait: block until something arrives.
+  // return false if the connection is closed.
+  bool Process(bool wait = false);
+
+private:
+  template <typename... ARGS>
+  void request_raw(const char *method, const on_raw_response_t &callback,
+                   ARGS... args) {
+    auto id = _next_id++;
+    msgpackpp::packer packer;
+    packer.pack_array(4);
+    packer << 0 << id << method;
+    packer.pack_array(sizeof...(args));
+    (void)(packer << ... << args);
+
+    _requests.emplace(id, callback);
+    write_async(packer.get_payload());
+  }
+
+  void Dispatch(const uint8_t *data, size_t size);
+  // data may be incomplete
+  bool BeginStream(const uint8_t *data, size_t size);
+  void Stream(const uint8_t *data, size_t size);
+};
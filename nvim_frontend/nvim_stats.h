@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+namespace Nvim {
+
+// outgoing rpc. see NvimStreamTransport::write_async
+struct WriteStats {
+  uint64_t writes;
+  uint64_t messages;
+  uint64_t bytes;
+
+  double MessagesPerWrite() const {
+    return writes ? static_cast<double>(messages) / writes : 0;
+  }
+  double BytesPerWrite() const {
+    return writes ? static_cast<double>(bytes) / writes : 0;
+  }
+};
+
+// see NvimRedraw::Render and DispatchEvent
+struct RedrawStats {
+  // flush events received
+  uint64_t flushes;
+  // frames actually drawn
+  uint64_t frames;
+  // flushes collapsed into a later frame
+  uint64_t dropped_frames;
+  // events NvimRedraw does not handle
+  uint64_t unknown_events;
+  // heap blocks taken by the per batch arena. constant after warm-up
+  uint64_t arena_heap_allocations;
+  // row marks by the appliers, and rows actually drawn. the difference is
+  // redundant row draws saved by the dirty bitset
+  uint64_t rows_marked;
+  uint64_t rows_rendered;
+  // grid_scroll moved by NvimRenderer::ScrollRect instead of redrawn
+  uint64_t scroll_blits;
+};
+
+} // namespace Nvim
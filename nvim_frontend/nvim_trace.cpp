@@ -0,0 +1,48 @@
+#include "nvim_trace.h"
+#include <chrono>
+
+namespace Nvim {
+
+TraceRing &TraceRing::Instance() {
+  static TraceRing s_ring;
+  return s_ring;
+}
+
+int64_t TraceRing::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+size_t TraceRing::Dump(FILE *fp) const {
+  auto next = _next.load(std::memory_order_acquire);
+  auto begin = next > CAPACITY ? next - CAPACITY : 0;
+  size_t count = 0;
+  for (auto index = begin; index < next; ++index) {
+    auto &record = _records[index & (CAPACITY - 1)];
+    auto sequence = record.sequence.load(std::memory_order_acquire);
+    if (sequence != index + 1) {
+      // being written or already overwritten
+      continue;
+    }
+    auto time_ns = record.time_ns;
+    auto event = static_cast<uint16_t>(record.event);
+    int32_t args[4];
+    for (int i = 0; i < 4; ++i) {
+      args[i] = record.args[i];
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record.sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+
+    fwrite(&sequence, sizeof(sequence), 1, fp);
+    fwrite(&time_ns, sizeof(time_ns), 1, fp);
+    fwrite(&event, sizeof(event), 1, fp);
+    fwrite(args, sizeof(args), 1, fp);
+    ++count;
+  }
+  return count;
+}
+
+} // namespace Nvim
@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary tracing for the hot paths, in place of plog.
+//
+// Build with -DNVIM_FRONTEND_TRACE=ON to compile it in. Otherwise NVIM_TRACE
+// expands to nothing. When compiled in but not enabled, a trace point costs
+// one relaxed load and a branch.
+//
+// Records are fixed size and go into a lock free ring that keeps the newest
+// TraceRing::CAPACITY of them. Nothing is formatted at the trace point;
+// Dump writes the raw records for offline formatting by
+// tools/nvim_trace_format.
+//
+// NVIM_TRACE(Nvim::TraceEvent::RpcSend, size);
+
+namespace Nvim {
+
+enum class TraceEvent : uint16_t {
+  // bytes
+  RpcSend,
+  // top, bottom, rows
+  GridScroll,
+  // records applied since the previous flush
+  Flush,
+  Count,
+};
+
+constexpr const char *TraceEventName(TraceEvent event) {
+  switch (event) {
+  case TraceEvent::RpcSend:
+    return "rpc_send";
+  case TraceEvent::GridScroll:
+    return "grid_scroll";
+  case TraceEvent::Flush:
+    return "flush";
+  default:
+    return "unknown";
+  }
+}
+
+// args used by each event. see the enum
+constexpr int TraceEventArgCount(TraceEvent event) {
+  switch (event) {
+  case TraceEvent::RpcSend:
+    return 1;
+  case TraceEvent::GridScroll:
+    return 3;
+  case TraceEvent::Flush:
+    return 1;
+  default:
+    return 4;
+  }
+}
+
+struct TraceRecord {
+  // 0 while being written. written slots have (index + 1)
+  std::atomic<uint64_t> sequence;
+  // steady clock
+  int64_t time_ns;
+  TraceEvent event;
+  int32_t args[4];
+};
+
+class TraceRing {
+public:
+  // power of two
+  static constexpr size_t CAPACITY = 4096;
+
+private:
+  TraceRecord _records[CAPACITY] = {};
+  std::atomic<uint64_t> _next = 0;
+  std::atomic<bool> _enabled = false;
+
+  static int64_t Now();
+
+public:
+  static TraceRing &Instance();
+
+  void Enable(bool enable) { _enabled.store(enable); }
+  bool Enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+  // any thread
+  template <typename... ARGS> void Write(TraceEvent event, ARGS... args) {
+    static_assert(sizeof...(args) <= 4);
+    auto index = _next.fetch_add(1, std::memory_order_relaxed);
+    auto &record = _records[index & (CAPACITY - 1)];
+    record.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.time_ns = Now();
+    record.event = event;
+    int32_t values[4] = {static_cast<int32_t>(args)...};
+    for (int i = 0; i < 4; ++i) {
+      record.args[i] = values[i];
+    }
+    record.sequence.store(index + 1, std::memory_order_release);
+  }
+
+  // Write the records in order as
+  // {uint64_t sequence, int64_t time_ns, uint16_t event, int32_t args[4]}.
+  // Records overwritten while dumping are skipped. Returns the count.
+  size_t Dump(FILE *fp) const;
+};
+
+} // namespace Nvim
+
+#ifdef NVIM_TRACE_ENABLED
+#define NVIM_TRACE(...)                                                        \
+  do {                                                                         \
+    auto &nvim_trace_ring = Nvim::TraceRing::Instance();                       \
+    if (nvim_trace_ring.Enabled()) {                                           \
+      nvim_trace_ring.Write(__VA_ARGS__);                                      \
+    }                                                                          \
+  } while (0)
+#else
+#define NVIM_TRACE(...) ((void)0)
+#endif
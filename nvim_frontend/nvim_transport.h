@@ -0,0 +1,252 @@
+#pragma once
+#include "nvim_recv_buffer.h"
+#include "nvim_stats.h"
+#include <asio.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <vector>
+
+// Pipe or socket transport for NvimRpc.
+//
+// Reads and writes run on the shared NvimIOPool threads. Reads go straight
+// into an NvimRecvBuffer, and complete messages are handed out in place only
+// from Deliver(), which the owner calls on its own (UI) thread. So rpc
+// handlers such as "redraw" keep running on the thread that owns the
+// renderer, and received bytes are never copied on the way to the parser.
+//
+// Outgoing messages are appended to one pending buffer. Everything queued
+// before the io thread gets to it goes out in a single write, so a burst of
+// key repeats or mouse drags costs one syscall per io tick, not one per
+// message.
+//
+// Copies share one channel.
+template <typename Stream> class NvimStreamTransport {
+public:
+  using on_closed_t = std::function<void()>;
+
+private:
+  struct Channel {
+    asio::strand<asio::io_context::executor_type> _strand;
+    Stream _read;
+    // empty for a duplex stream such as a socket
+    std::optional<Stream> _write;
+    NvimRecvBuffer _recv;
+    on_closed_t _on_closed;
+
+    std::mutex _write_mutex;
+    // appended by write_async. swapped with _writing on flush.
+    // both keep their capacity, so steady state does not allocate
+    std::vector<uint8_t> _pending;
+    uint64_t _pending_messages = 0;
+    std::vector<uint8_t> _writing;
+    bool _flush_scheduled = false;
+    int _corked = 0;
+
+    std::atomic<uint64_t> _writes = 0;
+    std::atomic<uint64_t> _messages = 0;
+    std::atomic<uint64_t> _bytes = 0;
+
+    template <typename Handle>
+    Channel(asio::io_context &context, Handle read, Handle write)
+        : _strand(asio::make_strand(context)), _read(context, read),
+          _write(std::in_place, context, write) {}
+
+    template <typename Handle>
+    Channel(asio::io_context &context, Handle duplex)
+        : _strand(asio::make_strand(context)), _read(context, duplex) {}
+
+    Stream &Writer() { return _write ? *_write : _read; }
+  };
+  std::shared_ptr<Channel> _channel;
+
+public:
+  NvimStreamTransport() {}
+  // takes ownership of the handles
+  template <typename Handle>
+  NvimStreamTransport(asio::io_context &context, Handle read, Handle write)
+      : _channel(std::make_shared<Channel>(context, read, write)) {}
+  // connected socket or named pipe
+  template <typename Handle>
+  NvimStreamTransport(asio::io_context &context, Handle duplex)
+      : _channel(std::make_shared<Channel>(context, duplex)) {}
+
+  explicit operator bool() const { return _channel != nullptr; }
+
+  // invoked on an io thread when the peer closes. set before start_read.
+  // not invoked after Close
+  void set_on_closed(const on_closed_t &callback) {
+    _channel->_on_closed = callback;
+  }
+
+  void start_read() {
+    auto [p, size] = _channel->_recv.BeginRead();
+    if (p) {
+      post_read(_channel, p, size);
+    }
+  }
+
+  void write_async(const std::vector<uint8_t> &bytes) {
+    write_async(bytes.data(), bytes.size());
+  }
+
+  // one packed message
+  void write_async(const uint8_t *data, size_t size) {
+    bool schedule;
+    {
+      std::lock_guard<std::mutex> lock(_channel->_write_mutex);
+      _channel->_pending.insert(_channel->_pending.end(), data, data + size);
+      ++_channel->_pending_messages;
+      schedule = ScheduleFlush();
+    }
+    if (schedule) {
+      auto channel = _channel;
+      asio::post(channel->_strand, [channel]() { flush(channel); });
+    }
+  }
+
+  // Hold messages back until uncork, so they surely share one write.
+  // Nestable.
+  void cork() {
+    std::lock_guard<std::mutex> lock(_channel->_write_mutex);
+    ++_channel->_corked;
+  }
+
+  void uncork() {
+    bool schedule;
+    {
+      std::lock_guard<std::mutex> lock(_channel->_write_mutex);
+      --_channel->_corked;
+      schedule = !_channel->_pending.empty() && ScheduleFlush();
+    }
+    if (schedule) {
+      auto channel = _channel;
+      asio::post(channel->_strand, [channel]() { flush(channel); });
+    }
+  }
+
+  Nvim::WriteStats write_stats() const {
+    return {
+        _channel->_writes.load(),
+        _channel->_messages.load(),
+        _channel->_bytes.load(),
+    };
+  }
+
+  // Call on the owner thread.
+  // on_message(const uint8_t *data, size_t size) is called for each complete
+  // message received so far, then on_partial(data, size) with the bytes of
+  // an incomplete one. data is valid only during the call.
+  // wait: block until something arrives or the stream is closed.
+  // return false if closed.
+  template <typename F, typename P>
+  bool Deliver(const F &on_message, const P &on_partial, bool wait = false) {
+    if (wait && !_channel->_recv.Wait()) {
+      return false;
+    }
+    auto [p, size] = _channel->_recv.Consume(on_message, on_partial);
+    if (p) {
+      // the reader stalled on a full buffer
+      post_read(_channel, p, size);
+    }
+    return !_channel->_recv.Closed();
+  }
+
+  // Pending operations are aborted and the handles are closed on the pool.
+  void Close() {
+    if (!_channel) {
+      return;
+    }
+    auto channel = _channel;
+    asio::post(channel->_strand, [channel]() {
+      // our own close, not the peer's. the owner may be gone already
+      channel->_on_closed = nullptr;
+      asio::error_code ec;
+      channel->_read.close(ec);
+      if (channel->_write) {
+        channel->_write->close(ec);
+      }
+    });
+  }
+
+private:
+  // with _write_mutex
+  bool ScheduleFlush() {
+    if (_channel->_corked || _channel->_flush_scheduled) {
+      return false;
+    }
+    _channel->_flush_scheduled = true;
+    return true;
+  }
+
+  static void post_read(const std::shared_ptr<Channel> &channel, uint8_t *p,
+                        size_t size) {
+    asio::post(channel->_strand,
+               [channel, p, size]() { read_loop(channel, p, size); });
+  }
+
+  static void read_loop(const std::shared_ptr<Channel> &channel, uint8_t *p,
+                        size_t size) {
+    channel->_read.async_read_some(
+        asio::buffer(p, size),
+        asio::bind_executor(channel->_strand, [channel](
+                                                  const asio::error_code &ec,
+                                                  size_t size) {
+          if (ec) {
+            // eof when nvim exit. operation_aborted is our Close
+            channel->_recv.Close();
+            if (ec != asio::error::operation_aborted && channel->_on_closed) {
+              channel->_on_closed();
+            }
+            return;
+          }
+          auto [next, next_size] = channel->_recv.EndRead(size);
+          if (next) {
+            read_loop(channel, next, next_size);
+          }
+        }));
+  }
+
+  // on the strand. one write for everything pending
+  static void flush(const std::shared_ptr<Channel> &channel) {
+    {
+      std::lock_guard<std::mutex> lock(channel->_write_mutex);
+      if (channel->_pending.empty() || channel->_corked) {
+        // uncork schedules again
+        channel->_flush_scheduled = false;
+        return;
+      }
+      channel->_writing.swap(channel->_pending);
+      channel->_pending.clear();
+      channel->_messages += channel->_pending_messages;
+      channel->_pending_messages = 0;
+    }
+    ++channel->_writes;
+    channel->_bytes += channel->_writing.size();
+
+    asio::async_write(
+        channel->Writer(), asio::buffer(channel->_writing),
+        asio::bind_executor(channel->_strand, [channel](
+                                                  const asio::error_code &ec,
+                                                  size_t) {
+          if (ec) {
+            std::lock_guard<std::mutex> lock(channel->_write_mutex);
+            channel->_flush_scheduled = false;
+            return;
+          }
+          // anything queued while this write was in flight
+          flush(channel);
+        }));
+  }
+};
+
+#ifdef _WIN32
+// overlapped named pipe. see nvim_pipe_win32.cpp
+using NvimTransport = NvimStreamTransport<asio::windows::stream_handle>;
+#else
+// pipe or unix domain socket fd
+using NvimTransport = NvimStreamTransport<asio::posix::stream_descriptor>;
+#endif
@@ -0,0 +1,171 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NVIM_UNICODE_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NVIM_UNICODE_NEON
+#endif
+
+namespace Nvim {
+
+// Portable replacements for MultiByteToWideChar / WideCharToMultiByte.
+// The grid keeps codepoints (see Nvim::Cell). Renderers get UTF-16 code
+// units on every platform (even where wchar_t is 32bit), so they see the
+// same layout everywhere.
+
+// one codepoint from utf8. invalid sequences are U+FFFD
+inline uint32_t Utf8Next(const uint8_t *&p, const uint8_t *end) {
+  uint32_t cp;
+  int trail;
+  if (*p < 0x80) {
+    cp = *p;
+    trail = 0;
+  } else if ((*p & 0xE0) == 0xC0) {
+    cp = *p & 0x1F;
+    trail = 1;
+  } else if ((*p & 0xF0) == 0xE0) {
+    cp = *p & 0x0F;
+    trail = 2;
+  } else if ((*p & 0xF8) == 0xF0) {
+    cp = *p & 0x07;
+    trail = 3;
+  } else {
+    // invalid lead byte
+    cp = 0xFFFD;
+    trail = 0;
+  }
+  ++p;
+  for (int i = 0; i < trail; ++i, ++p) {
+    if (p >= end || (*p & 0xC0) != 0x80) {
+      return 0xFFFD;
+    }
+    cp = (cp << 6) | (*p & 0x3F);
+  }
+  return cp;
+}
+
+// return written code units, 1 or 2
+inline int CodepointToUtf16(uint32_t cp, wchar_t *dst) {
+  if (cp >= 0x10000) {
+    cp -= 0x10000;
+    dst[0] = static_cast<wchar_t>(0xD800 + (cp >> 10));
+    dst[1] = static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+    return 2;
+  }
+  dst[0] = static_cast<wchar_t>(cp);
+  return 1;
+}
+
+// utf8 -> codepoints. return written count. stops when dst is full
+inline size_t Utf8ToCodepoints(const char *src, size_t src_size, uint32_t *dst,
+                               size_t dst_size) {
+  auto p = reinterpret_cast<const uint8_t *>(src);
+  auto end = p + src_size;
+  size_t written = 0;
+  while (p < end && written < dst_size) {
+    dst[written++] = Utf8Next(p, end);
+  }
+  return written;
+}
+
+// utf8 -> utf16. return written code units. like MultiByteToWideChar
+inline int Utf8ToUtf16(const char *src, size_t src_size, wchar_t *dst,
+                       size_t dst_size) {
+  auto p = reinterpret_cast<const uint8_t *>(src);
+  auto end = p + src_size;
+  size_t written = 0;
+  while (p < end) {
+    auto cp = Utf8Next(p, end);
+    if (written + (cp >= 0x10000 ? 2 : 1) > dst_size) {
+      break;
+    }
+    written += CodepointToUtf16(cp, dst + written);
+  }
+  return static_cast<int>(written);
+}
+
+// ascii -> codepoints. src must be all < 0x80. 16 bytes per step where sse2
+// or neon is available
+inline void WidenAscii(const char *src, size_t size, uint32_t *dst) {
+  size_t i = 0;
+#if defined(NVIM_UNICODE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+    auto out = reinterpret_cast<__m128i *>(dst + i);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+  }
+#elif defined(NVIM_UNICODE_NEON)
+  for (; i + 16 <= size; i += 16) {
+    uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+    uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+    vst1q_u32(dst + i, vmovl_u16(vget_low_u16(lo)));
+    vst1q_u32(dst + i + 4, vmovl_u16(vget_high_u16(lo)));
+    vst1q_u32(dst + i + 8, vmovl_u16(vget_low_u16(hi)));
+    vst1q_u32(dst + i + 12, vmovl_u16(vget_high_u16(hi)));
+  }
+#endif
+  for (; i < size; ++i) {
+    dst[i] = static_cast<uint8_t>(src[i]);
+  }
+}
+
+// utf16 (or utf32 wchar_t) -> utf8. return written bytes without
+// terminator. src_size == -1 means null terminated.
+inline int Utf16ToUtf8(const wchar_t *src, int src_size, char *dst,
+                       size_t dst_size) {
+  size_t written = 0;
+  for (int i = 0; src_size < 0 ? src[i] != 0 : i < src_size; ++i) {
+    uint32_t cp = static_cast<uint32_t>(src[i]);
+    if (cp >= 0xD800 && cp < 0xDC00 &&
+        (src_size < 0 ? src[i + 1] != 0 : i + 1 < src_size)) {
+      uint32_t low = static_cast<uint32_t>(src[i + 1]);
+      if (low >= 0xDC00 && low < 0xE000) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        ++i;
+      }
+    }
+
+    uint8_t buf[4];
+    int n;
+    if (cp < 0x80) {
+      buf[0] = static_cast<uint8_t>(cp);
+      n = 1;
+    } else if (cp < 0x800) {
+      buf[0] = static_cast<uint8_t>(0xC0 | (cp >> 6));
+      buf[1] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+      n = 2;
+    } else if (cp < 0x10000) {
+      buf[0] = static_cast<uint8_t>(0xE0 | (cp >> 12));
+      buf[1] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+      buf[2] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+      n = 3;
+    } else {
+      buf[0] = static_cast<uint8_t>(0xF0 | (cp >> 18));
+      buf[1] = static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3F));
+      buf[2] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+      buf[3] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+      n = 4;
+    }
+    if (written + n > dst_size) {
+      break;
+    }
+    for (int j = 0; j < n; ++j) {
+      dst[written++] = static_cast<char>(buf[j]);
+    }
+  }
+  return static_cast<int>(written);
+}
+
+} // namespace Nvim
@@ -6,7 +6,9 @@
 #include <dwrite_3.h>
 #include <dxgi1_2.h>
 #include <nvim_grid.h>
+#include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <wrl/client.h>
 
@@ -469,6 +471,21 @@ class NvimRendererD2DImpl {
   std::unique_ptr<class DWriteImpl> _dwrite;
 
   bool _draw_active = false;
+  // target of the current draw. the layers are composited into it
+  ComPtr<ID2D1Bitmap1> _target_bitmap;
+  // one per grid. keeps the last frame of the grid, so ScrollRect copies
+  // within it and only dirty rows are drawn
+  struct Layer {
+    ComPtr<ID2D1Bitmap1> bitmap;
+  };
+  std::unordered_map<const Nvim::Grid *, Layer> _layers;
+  // set as the d2d target. nullptr: _target_bitmap or none
+  ID2D1Bitmap1 *_current_layer = nullptr;
+  // ScrollRect goes through this. source and dest may overlap
+  ComPtr<ID2D1Bitmap1> _scroll_bitmap;
+  // DrawGridLine. utf16 of the row and where each column starts in it
+  std::wstring _row_text;
+  std::vector<uint32_t> _text_pos;
 
   const Nvim::HighlightAttribute *_defaultHL = nullptr;
 
@@ -501,8 +518,8 @@ public:
   void ApplyHighlightAttributes(IDWriteTextLayout *text_layout, int start,
                                 int end, const Nvim::HighlightAttribute *hl_attribs) {
     ComPtr<GlyphDrawingEffect> drawing_effect;
-    GlyphDrawingEffect::Create(hl_attribs->CreateForegroundColor(),
-                               hl_attribs->CreateSpecialColor(),
+    GlyphDrawingEffect::Create(hl_attribs->resolved.foreground,
+                               hl_attribs->resolved.special,
                                &drawing_effect);
     DWRITE_TEXT_RANGE range{static_cast<uint32_t>(start),
                             static_cast<uint32_t>(end - start)};
@@ -526,7 +543,7 @@ public:
 
   void DrawBackgroundRect(D2D1_RECT_F rect,
                           const Nvim::HighlightAttribute *hl_attribs) {
-    auto color = hl_attribs->CreateBackgroundColor();
+    auto color = hl_attribs->resolved.background;
     _device->_d2d_background_rect_brush->SetColor(D2D1::ColorF(color));
     _device->_d2d_context->FillRectangle(
         rect, _device->_d2d_background_rect_brush.Get());
@@ -557,7 +574,7 @@ public:
                            uint32_t length,
                            const Nvim::HighlightAttribute *hl_attribs) {
     auto text_layout = _dwrite->GetTextLayout(rect, text, length);
-    this->ApplyHighlightAttributes(text_layout.Get(), 0, 1, hl_attribs);
+    this->ApplyHighlightAttributes(text_layout.Get(), 0, length, hl_attribs);
 
     _device->_d2d_context->PushAxisAlignedClip(rect,
                                                D2D1_ANTIALIAS_MODE_ALIASED);
@@ -566,24 +583,76 @@ public:
     _device->_d2d_context->PopAxisAlignedClip();
   }
 
+  // (re)create the layer of grid for its size and draw into it
+  ID2D1Bitmap1 *SelectLayer(const Nvim::Grid *grid) {
+    D2D1_SIZE_U size{
+        static_cast<UINT32>(ceilf(grid->Cols() * _dwrite->_font_width)),
+        static_cast<UINT32>(ceilf(grid->Rows() * _dwrite->_font_height))};
+    if (size.width == 0 || size.height == 0) {
+      return nullptr;
+    }
+
+    auto &layer = _layers[grid];
+    if (!layer.bitmap || layer.bitmap->GetPixelSize().width != size.width ||
+        layer.bitmap->GetPixelSize().height != size.height) {
+      // a resized grid or a new font redraws every row
+      constexpr D2D1_BITMAP_PROPERTIES1 layer_bitmap_properties{
+          D2D1_PIXEL_FORMAT{DXGI_FORMAT_B8G8R8A8_UNORM,
+                            D2D1_ALPHA_MODE_IGNORE},
+          DEFAULT_DPI, DEFAULT_DPI, D2D1_BITMAP_OPTIONS_TARGET};
+      layer.bitmap.Reset();
+      if (FAILED(_device->_d2d_context->CreateBitmap(
+              size, nullptr, 0, layer_bitmap_properties, &layer.bitmap))) {
+        _layers.erase(grid);
+        return nullptr;
+      }
+    }
+
+    if (_current_layer != layer.bitmap.Get()) {
+      _device->_d2d_context->SetTarget(layer.bitmap.Get());
+      _current_layer = layer.bitmap.Get();
+    }
+    return _current_layer;
+  }
+
+  ID2D1Bitmap1 *FindLayer(const Nvim::Grid *grid) const {
+    auto found = _layers.find(grid);
+    return found != _layers.end() ? found->second.bitmap.Get() : nullptr;
+  }
+
   void DrawGridLine(const Nvim::Grid *grid, int row) {
+    if (!SelectLayer(grid)) {
+      return;
+    }
+
     auto cols = grid->Cols();
-    int base = row * cols;
+    auto cells = grid->RowCells(row);
+    auto props = grid->RowProps(row);
+
+    _row_text.clear();
+    _text_pos.resize(cols + 1);
+    for (int i = 0; i < cols; ++i) {
+      _text_pos[i] = static_cast<uint32_t>(_row_text.size());
+      grid->AppendUtf16(cells[i], &_row_text);
+    }
+    _text_pos[cols] = static_cast<uint32_t>(_row_text.size());
 
     D2D1_RECT_F rect{0.0f, row * _dwrite->_font_height,
                      cols * _dwrite->_font_width,
 
                      (row * _dwrite->_font_height) + _dwrite->_font_height};
 
-    auto text_layout = _dwrite->GetTextLayout(rect, &grid->Chars()[base], cols);
+    auto text_layout = _dwrite->GetTextLayout(
+        rect, _row_text.data(), static_cast<uint32_t>(_row_text.size()));
 
-    uint16_t hl_attrib_id = grid->Props()[base].hl_attrib_id;
+    uint16_t hl_attrib_id = props[0].hl_attrib_id;
     int col_offset = 0;
     for (int i = 0; i < cols; ++i) {
+      DWRITE_TEXT_RANGE range{_text_pos[i], _text_pos[i + 1] - _text_pos[i]};
       // Add spacing for wide chars
-      if (grid->Props()[base + i].is_wide_char) {
-        float char_width = _dwrite->GetTextWidth(&grid->Chars()[base + i], 2);
-        DWRITE_TEXT_RANGE range{static_cast<uint32_t>(i), 1};
+      if (props[i].is_wide_char) {
+        float char_width =
+            _dwrite->GetTextWidth(&_row_text[range.startPosition], range.length);
         text_layout->SetCharacterSpacing(
             0, (_dwrite->_font_width * 2) - char_width, 0, range);
       }
@@ -591,10 +660,10 @@ public:
       // Add spacing for unicode chars. These characters are still single char
       // width, but some of them by default will take up a bit more or less,
       // leading to issues. So we realign them here.
-      else if (grid->Chars()[base + i] > 0xFF) {
-        float char_width = _dwrite->GetTextWidth(&grid->Chars()[base + i], 1);
+      else if (cells[i] > 0xFF) {
+        float char_width =
+            _dwrite->GetTextWidth(&_row_text[range.startPosition], range.length);
         if (abs(char_width - _dwrite->_font_width) > 0.01f) {
-          DWRITE_TEXT_RANGE range{static_cast<uint32_t>(i), 1};
           text_layout->SetCharacterSpacing(0, _dwrite->_font_width - char_width,
                                            0, range);
         }
@@ -602,17 +671,18 @@ public:
 
       // Check if the attributes change,
       // if so draw until this point and continue with the new attributes
-      if (grid->Props()[base + i].hl_attrib_id != hl_attrib_id) {
+      if (props[i].hl_attrib_id != hl_attrib_id) {
         D2D1_RECT_F bg_rect{
             col_offset * _dwrite->_font_width, row * _dwrite->_font_height,
             col_offset * _dwrite->_font_width +
                 _dwrite->_font_width * (i - col_offset),
             (row * _dwrite->_font_height) + _dwrite->_font_height};
         this->DrawBackgroundRect(bg_rect, &grid->hl(hl_attrib_id));
-        this->ApplyHighlightAttributes(text_layout.Get(), col_offset, i,
+        this->ApplyHighlightAttributes(text_layout.Get(),
+                                       _text_pos[col_offset], _text_pos[i],
                                        &grid->hl(hl_attrib_id));
 
-        hl_attrib_id = grid->Props()[base + i].hl_attrib_id;
+        hl_attrib_id = props[i].hl_attrib_id;
         col_offset = i;
       }
     }
@@ -623,45 +693,53 @@ public:
     D2D1_RECT_F last_rect = rect;
     last_rect.left = col_offset * _dwrite->_font_width;
     this->DrawBackgroundRect(last_rect, &grid->hl(hl_attrib_id));
-    this->ApplyHighlightAttributes(text_layout.Get(), col_offset, cols,
-                                   &grid->hl(hl_attrib_id));
+    this->ApplyHighlightAttributes(text_layout.Get(), _text_pos[col_offset],
+                                   _text_pos[cols], &grid->hl(hl_attrib_id));
 
     _device->_d2d_context->PushAxisAlignedClip(rect,
                                                D2D1_ANTIALIAS_MODE_ALIASED);
-    _dwrite->SetTypographyIfNotLigatures(text_layout,
-                                         static_cast<uint32_t>(cols));
+    _dwrite->SetTypographyIfNotLigatures(text_layout, _text_pos[cols]);
     text_layout->Draw(this, _device->_glyph_renderer.Get(), 0.0f, rect.top);
     _device->_d2d_context->PopAxisAlignedClip();
   }
 
   void DrawCursor(const Nvim::Grid *grid) {
-    int cursor_grid_offset = grid->CursorOffset();
+    bool in_grid = grid->CursorRow() < grid->Rows() &&
+                   grid->CursorCol() < grid->Cols();
 
     int double_width_char_factor = 1;
-    if (cursor_grid_offset < grid->Count() &&
-        grid->Props()[cursor_grid_offset].is_wide_char) {
+    if (in_grid &&
+        grid->RowProps(grid->CursorRow())[grid->CursorCol()].is_wide_char) {
       double_width_char_factor += 1;
     }
 
     auto cursor_hl_attribs = grid->hl(grid->CursorModeHighlightAttribute());
     if (grid->CursorModeHighlightAttribute() == 0) {
       cursor_hl_attribs.flags ^= Nvim::HL_ATTRIB_REVERSE;
+      cursor_hl_attribs.resolved = cursor_hl_attribs.Resolve(grid->hl(0));
     }
 
-    D2D1_RECT_F cursor_rect{grid->CursorCol() * _dwrite->_font_width,
-                            grid->CursorRow() * _dwrite->_font_height,
-                            grid->CursorCol() * _dwrite->_font_width +
+    // drawn over the composited layers
+    auto &placement = grid->Placement();
+    int cursor_row = placement.row + grid->CursorRow();
+    int cursor_col = placement.col + grid->CursorCol();
+    D2D1_RECT_F cursor_rect{cursor_col * _dwrite->_font_width,
+                            cursor_row * _dwrite->_font_height,
+                            cursor_col * _dwrite->_font_width +
                                 _dwrite->_font_width * double_width_char_factor,
-                            (grid->CursorRow() * _dwrite->_font_height) +
+                            (cursor_row * _dwrite->_font_height) +
                                 _dwrite->_font_height};
     D2D1_RECT_F cursor_fg_rect =
         this->GetCursorForegroundRect(cursor_rect, grid->GetCursorShape());
     this->DrawBackgroundRect(cursor_fg_rect, &cursor_hl_attribs);
 
-    if (grid->GetCursorShape() == Nvim::CursorShape::Block) {
-      this->DrawHighlightedText(cursor_fg_rect,
-                                &grid->Chars()[cursor_grid_offset],
-                                double_width_char_factor, &cursor_hl_attribs);
+    if (in_grid && grid->GetCursorShape() == Nvim::CursorShape::Block) {
+      std::wstring text;
+      grid->AppendUtf16(grid->RowCells(grid->CursorRow())[grid->CursorCol()],
+                        &text);
+      this->DrawHighlightedText(cursor_fg_rect, text.data(),
+                                static_cast<uint32_t>(text.size()),
+                                &cursor_hl_attribs);
     }
   }
 
@@ -687,10 +765,44 @@ public:
     }
   }
 
-  void DrawBackgroundRect(int rows, int cols, const Nvim::HighlightAttribute *hl) {
-    D2D1_RECT_F rect{0.0f, 0.0f, cols * _dwrite->_font_width,
-                     rows * _dwrite->_font_height};
-    this->DrawBackgroundRect(rect, hl);
+  // grids in order, each at its placement. the later one is on top
+  void Composite(const Nvim::Grid *const *grids, size_t count) {
+    if (!_target_bitmap) {
+      return;
+    }
+    _device->_d2d_context->SetTarget(_target_bitmap.Get());
+    _current_layer = nullptr;
+
+    for (size_t i = 0; i < count; ++i) {
+      auto bitmap = FindLayer(grids[i]);
+      if (!bitmap) {
+        continue;
+      }
+      auto &placement = grids[i]->Placement();
+      auto size = bitmap->GetPixelSize();
+      // whole pixels. no filtering
+      D2D1_RECT_F dst{roundf(placement.col * _dwrite->_font_width),
+                      roundf(placement.row * _dwrite->_font_height), 0.0f,
+                      0.0f};
+      dst.right = dst.left + size.width;
+      dst.bottom = dst.top + size.height;
+      _device->_d2d_context->DrawBitmap(
+          bitmap, &dst, 1.0f, D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR);
+    }
+  }
+
+  void ReleaseGrid(const Nvim::Grid *grid) {
+    auto found = _layers.find(grid);
+    if (found == _layers.end()) {
+      return;
+    }
+    if (_current_layer == found->second.bitmap.Get()) {
+      _current_layer = nullptr;
+      if (_draw_active) {
+        _device->_d2d_context->SetTarget(_target_bitmap.Get());
+      }
+    }
+    _layers.erase(found);
   }
 
   std::tuple<int, int> StartDraw() {
@@ -721,6 +833,8 @@ public:
     }
 
     auto size = d2d_target_bitmap->GetPixelSize();
+    _target_bitmap = d2d_target_bitmap;
+    _current_layer = nullptr;
 
     return {size.width, size.height};
   }
@@ -728,9 +842,55 @@ public:
   void FinishDraw() {
     _device->_d2d_context->EndDraw();
     _device->_d2d_context->SetTarget(nullptr);
+    _target_bitmap.Reset();
+    _current_layer = nullptr;
     this->_draw_active = false;
   }
 
+  // the layer still has the last frame of the grid
+  void ScrollRect(const Nvim::Grid *grid, int top, int bottom, int left,
+                  int right, int rows) {
+    int count = bottom - top - abs(rows);
+    auto layer = FindLayer(grid);
+    if (!layer || count <= 0) {
+      return;
+    }
+    int src_top = rows > 0 ? top + rows : top;
+    int dst_top = rows > 0 ? top : top - rows;
+
+    auto size = layer->GetPixelSize();
+    D2D1_RECT_U src{
+        static_cast<UINT32>(roundf(left * _dwrite->_font_width)),
+        static_cast<UINT32>(roundf(src_top * _dwrite->_font_height)),
+        static_cast<UINT32>(roundf(right * _dwrite->_font_width)),
+        static_cast<UINT32>(roundf((src_top + count) * _dwrite->_font_height))};
+    src.right = std::min(src.right, size.width);
+    src.bottom = std::min(src.bottom, size.height);
+    if (src.left >= src.right || src.top >= src.bottom) {
+      return;
+    }
+
+    if (!_scroll_bitmap || _scroll_bitmap->GetPixelSize().width < size.width ||
+        _scroll_bitmap->GetPixelSize().height < size.height) {
+      constexpr D2D1_BITMAP_PROPERTIES1 scroll_bitmap_properties{
+          D2D1_PIXEL_FORMAT{DXGI_FORMAT_B8G8R8A8_UNORM,
+                            D2D1_ALPHA_MODE_IGNORE},
+          DEFAULT_DPI, DEFAULT_DPI, D2D1_BITMAP_OPTIONS_NONE};
+      _scroll_bitmap.Reset();
+      if (FAILED(_device->_d2d_context->CreateBitmap(
+              size, nullptr, 0, scroll_bitmap_properties, &_scroll_bitmap))) {
+        return;
+      }
+    }
+
+    D2D1_POINT_2U origin{0, 0};
+    _scroll_bitmap->CopyFromBitmap(&origin, layer, &src);
+    D2D1_POINT_2U dst{
+        src.left, static_cast<UINT32>(roundf(dst_top * _dwrite->_font_height))};
+    D2D1_RECT_U copied{0, 0, src.right - src.left, src.bottom - src.top};
+    layer->CopyFromBitmap(&dst, _scroll_bitmap.Get(), &copied);
+  }
+
   void SetDpiScale(float current_dpi) { _dwrite->SetDpiScale(current_dpi); }
 
   void ResizeFont(float size) { _dwrite->ResizeFont(size); }
@@ -943,11 +1103,20 @@ void NvimRendererD2D::SetFont(std::string_view font, float size) {
   _impl->SetFont(font, size);
 }
 
-void NvimRendererD2D::DrawBackgroundRect(int rows, int cols,
-                                         const Nvim::HighlightAttribute *hl) {
-  _impl->DrawBackgroundRect(rows, cols, hl);
+void NvimRendererD2D::Composite(const Nvim::Grid *const *grids,
+                                size_t count) {
+  _impl->Composite(grids, count);
+}
+
+void NvimRendererD2D::ReleaseGrid(const Nvim::Grid *grid) {
+  _impl->ReleaseGrid(grid);
 }
 
 std::tuple<int, int> NvimRendererD2D::StartDraw() { return _impl->StartDraw(); }
 
 void NvimRendererD2D::FinishDraw() { _impl->FinishDraw(); }
+
+void NvimRendererD2D::ScrollRect(const Nvim::Grid *grid, int top, int bottom,
+                                 int left, int right, int rows) {
+  _impl->ScrollRect(grid, top, bottom, left, right, rows);
+}
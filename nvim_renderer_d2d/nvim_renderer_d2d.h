@@ -22,10 +22,13 @@ public:
   // render
   std::tuple<int, int> StartDraw() override;
   void FinishDraw() override;
-  void DrawBackgroundRect(int rows, int cols,
-                          const Nvim::HighlightAttribute *hl) override;
   void DrawGridLine(const Nvim::Grid *grid, int row) override;
+  void Composite(const Nvim::Grid *const *grids, size_t count) override;
+  void ReleaseGrid(const Nvim::Grid *grid) override;
   void DrawCursor(const Nvim::Grid *grid) override;
   void DrawBorderRectangles(const Nvim::Grid *grid, int width,
                             int height) override;
+  bool CanScrollRect() const override { return true; }
+  void ScrollRect(const Nvim::Grid *grid, int top, int bottom, int left,
+                  int right, int rows) override;
 };
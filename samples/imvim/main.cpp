@@ -19,6 +19,7 @@
 #include <plog/Formatters/TxtFormatter.h>
 #include <plog/Init.h>
 #include <plog/Log.h>
+#include <string.h>
 #include <tchar.h>
 #include <wrl/client.h>
 
@@ -435,6 +436,8 @@ public:
     auto gridSize = Nvim::GridSize::FromWindowSize(640, 640, ceilf(font_width),
                                                    ceilf(font_height));
 
+    // Process is called once per frame. draw once per frame
+    _nvim.SetRedrawBackpressure(true);
     // nvim_attach_ui. start redraw message
     _nvim.AttachUI(&_renderer, gridSize.rows, gridSize.cols);
   }
@@ -502,10 +505,20 @@ private:
 };
 
 // Main code
-int main(int, char **) {
+// imvim [--trace trace.bin]
+// --trace: dump the trace ring on exit. see tools/nvim_trace_format
+int main(int argc, char **argv) {
   static plog::DebugOutputAppender<plog::TxtFormatter> debugOutputAppender;
   plog::init(plog::verbose, &debugOutputAppender);
 
+  const char *trace_path = nullptr;
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (strcmp(argv[i], "--trace") == 0) {
+      trace_path = argv[++i];
+    }
+  }
+  NvimFrontend::EnableTrace(trace_path != nullptr);
+
   //
   // launch nvim
   //
@@ -573,5 +586,12 @@ int main(int, char **) {
     d3d.Present();
   }
 
+  if (trace_path) {
+    if (auto fp = fopen(trace_path, "wb")) {
+      auto count = NvimFrontend::DumpTrace(fp);
+      fclose(fp);
+      PLOGD << "trace: " << count << " records to " << trace_path;
+    }
+  }
   return 0;
 }
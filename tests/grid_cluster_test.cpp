@@ -0,0 +1,33 @@
+// The cluster intern table stays bounded while grid_line keeps replacing
+// clusters, and the cells still in use keep theirs. see Grid::MakeCell
+#include "nvim_grid.h"
+#include "nvim_test.h"
+#include <string>
+
+int main() {
+  Nvim::Grid grid;
+  grid.RowsCols(2, 4);
+
+  // e + combining acute, kept in the last cell throughout
+  const uint32_t kept[] = {U'e', 0x301};
+  grid.RowCells(1)[3] = grid.MakeCell(kept, 2);
+
+  // a new cluster into the first cell every time, like a spinner in a
+  // statusline
+  for (uint32_t i = 0; i < 100000; ++i) {
+    const uint32_t spinner[] = {0x2800 + (i % 0x100), 0x300 + (i / 0x100)};
+    grid.RowCells(0)[0] = grid.MakeCell(spinner, 2);
+    NVIM_EXPECT(grid.ClusterCount() <= Nvim::MIN_CLUSTER_LIMIT);
+  }
+
+  auto cell = grid.RowCells(1)[3];
+  NVIM_EXPECT(cell & Nvim::CELL_CLUSTER);
+  NVIM_EXPECT(grid.Cluster(cell) == std::u32string(U"e\u0301"));
+  // interned again as the same cell
+  NVIM_EXPECT(grid.MakeCell(kept, 2) == cell);
+
+  const uint32_t last[] = {0x2800 + (99999 % 0x100), 0x300 + (99999 / 0x100)};
+  NVIM_EXPECT(grid.Cluster(grid.RowCells(0)[0]) ==
+              std::u32string(reinterpret_cast<const char32_t *>(last), 2));
+  return 0;
+}
@@ -0,0 +1,73 @@
+// floats of the same zindex stack in the order they were placed. HitTest
+// picks the one Composite draws on top. see NvimRedraw::_grid_order
+#include "nvim_grid.h"
+#include "nvim_redraw.h"
+#include "nvim_test.h"
+#include "redraw_batch.h"
+#include <msgpackpp/msgpackpp.h>
+
+class LayerRenderer : public NvimTest::NullRenderer {
+public:
+  // grid ids, bottom first
+  std::vector<int> layers;
+  void Composite(const Nvim::Grid *const *grids, size_t count) override {
+    layers.clear();
+    for (size_t i = 0; i < count; ++i) {
+      layers.push_back(grids[i]->Id());
+    }
+  }
+};
+
+// a 3x5 float at row 1, col 1 of the global grid
+static void Float(NvimTest::Writer &w, int grid, int zindex) {
+  w.Array(2).Str("win_float_pos");
+  w.Array(8).Int(grid).Int(1000 + grid).Str("NW").Int(1);
+  w.Float(1.0).Float(1.0).Int(1).Int(zindex);
+}
+
+static void Dispatch(NvimRedraw &redraw, Nvim::Grid &grid,
+                     LayerRenderer &renderer, const NvimTest::Writer &w) {
+  auto &buffer = w.Buffer();
+  msgpackpp::parser params(buffer.data(), static_cast<int>(buffer.size()));
+  redraw.Dispatch(&grid, &renderer, params);
+}
+
+int main() {
+  Nvim::Grid global;
+  LayerRenderer renderer;
+  NvimRedraw redraw;
+
+  NvimTest::Writer w;
+  w.Array(7);
+  w.Array(2).Str("grid_resize").Array(3).Int(1).Int(20).Int(10);
+  // grid 3 is created first, grid 2 placed last
+  w.Array(2).Str("grid_resize").Array(3).Int(3).Int(5).Int(3);
+  w.Array(2).Str("grid_resize").Array(3).Int(2).Int(5).Int(3);
+  Float(w, 3, 50);
+  Float(w, 2, 50);
+  Float(w, 4, 10);
+  w.Array(2).Str("flush").Array(0);
+  Dispatch(redraw, global, renderer, w);
+  NVIM_EXPECT((renderer.layers == std::vector<int>{1, 4, 3, 2}));
+  NVIM_EXPECT((redraw.HitTest(&global, 2, 3) == std::tuple{2, 1, 2}));
+  NVIM_EXPECT((redraw.HitTest(&global, 0, 0) == std::tuple{1, 0, 0}));
+
+  // placing grid 3 again raises it over grid 2
+  NvimTest::Writer raise;
+  raise.Array(2);
+  Float(raise, 3, 50);
+  raise.Array(2).Str("flush").Array(0);
+  Dispatch(redraw, global, renderer, raise);
+  NVIM_EXPECT((renderer.layers == std::vector<int>{1, 4, 2, 3}));
+  NVIM_EXPECT((redraw.HitTest(&global, 2, 3) == std::tuple{3, 1, 2}));
+
+  // a higher zindex wins regardless of order
+  NvimTest::Writer higher;
+  higher.Array(2);
+  Float(higher, 2, 60);
+  higher.Array(2).Str("flush").Array(0);
+  Dispatch(redraw, global, renderer, higher);
+  NVIM_EXPECT((renderer.layers == std::vector<int>{1, 4, 3, 2}));
+  NVIM_EXPECT((redraw.HitTest(&global, 2, 3) == std::tuple{2, 1, 2}));
+  return 0;
+}
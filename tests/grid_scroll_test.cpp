@@ -0,0 +1,87 @@
+// grid_scroll and grid_line outside their grid do nothing. A window grid is
+// 0x0 until its grid_resize, and nothing is blitted for a scroll that did
+// not move. see NvimRedraw::ScrollRegion
+#include "nvim_grid.h"
+#include "nvim_redraw.h"
+#include "nvim_test.h"
+#include "redraw_batch.h"
+#include <msgpackpp/msgpackpp.h>
+
+class ScrollRenderer : public NvimTest::NullRenderer {
+public:
+  int scrolls = 0;
+  bool CanScrollRect() const override { return true; }
+  void ScrollRect(const Nvim::Grid *, int, int, int, int, int) override {
+    ++scrolls;
+  }
+};
+
+static void Scroll(NvimTest::Writer &w, int grid, int top, int bottom,
+                   int rows) {
+  w.Array(2).Str("grid_scroll");
+  w.Array(7).Int(grid).Int(top).Int(bottom).Int(0).Int(4).Int(rows).Int(0);
+}
+
+static void Line(NvimTest::Writer &w, int grid, int row) {
+  w.Array(2).Str("grid_line");
+  w.Array(4).Int(grid).Int(row).Int(0).Array(1).Array(3).Str("x").Int(0).Int(4);
+}
+
+static void Dispatch(NvimRedraw &redraw, Nvim::Grid &grid,
+                     ScrollRenderer &renderer, const NvimTest::Writer &w) {
+  auto &buffer = w.Buffer();
+  msgpackpp::parser params(buffer.data(), static_cast<int>(buffer.size()));
+  redraw.Dispatch(&grid, &renderer, params);
+}
+
+int main() {
+  {
+    Nvim::Grid grid;
+    NVIM_EXPECT(!grid.Scroll(0, 3, 0, 4, 1));
+    grid.RowsCols(3, 4);
+    NVIM_EXPECT(!grid.Scroll(0, 3, 0, 4, 0));
+    NVIM_EXPECT(!grid.Scroll(0, 30, 0, 4, 1));
+    NVIM_EXPECT(!grid.Scroll(0, 3, 0, 40, 1));
+    NVIM_EXPECT(grid.Scroll(0, 3, 0, 4, 1));
+    NVIM_EXPECT(grid.Scroll(0, 3, 1, 3, -1));
+  }
+
+  Nvim::Grid global;
+  ScrollRenderer renderer;
+  NvimRedraw redraw;
+
+  // window grid 2 has no grid_resize yet
+  NvimTest::Writer w;
+  w.Array(5);
+  w.Array(2).Str("grid_resize").Array(3).Int(1).Int(4).Int(3);
+  Scroll(w, 2, 0, 3, 1);
+  Line(w, 2, 2);
+  Scroll(w, 2, 0, 3, 200);
+  w.Array(2).Str("flush").Array(0);
+  Dispatch(redraw, global, renderer, w);
+  NVIM_EXPECT(renderer.scrolls == 0);
+  NVIM_EXPECT(redraw.Stats().scroll_blits == 0);
+
+  // the global grid is 4x3. regions past it do not move
+  NvimTest::Writer out_of_range;
+  out_of_range.Array(4);
+  Scroll(out_of_range, 1, 0, 30, 1);
+  Scroll(out_of_range, 1, 2, 1, 1);
+  Scroll(out_of_range, 1, 0, 3, 0);
+  out_of_range.Array(2).Str("flush").Array(0);
+  Dispatch(redraw, global, renderer, out_of_range);
+  NVIM_EXPECT(renderer.scrolls == 0);
+
+  // a region inside it is blitted once, its exposed row redrawn
+  auto rendered = redraw.Stats().rows_rendered;
+  NvimTest::Writer in_range;
+  in_range.Array(3);
+  Scroll(in_range, 1, 0, 3, 1);
+  Line(in_range, 1, 2);
+  in_range.Array(2).Str("flush").Array(0);
+  Dispatch(redraw, global, renderer, in_range);
+  NVIM_EXPECT(renderer.scrolls == 1);
+  NVIM_EXPECT(redraw.Stats().scroll_blits == 1);
+  NVIM_EXPECT(redraw.Stats().rows_rendered - rendered == 1);
+  return 0;
+}
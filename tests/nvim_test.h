@@ -0,0 +1,13 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+
+// Each test is a plain executable run by ctest. A failed expectation prints
+// where and exits non zero.
+#define NVIM_EXPECT(cond)                                                      \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #cond);     \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
@@ -0,0 +1,49 @@
+// After warm-up a redraw batch does not touch the heap: decoded records go
+// to the batch buffer and the arena, both of which keep their capacity.
+// see Nvim::Arena
+#include "nvim_grid.h"
+#include "nvim_redraw.h"
+#include "nvim_test.h"
+#include "redraw_batch.h"
+#include <atomic>
+#include <msgpackpp/msgpackpp.h>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> g_allocations;
+
+void *operator new(size_t size) {
+  ++g_allocations;
+  if (auto p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+int main() {
+  auto batch = NvimTest::MakeRedrawBatch(20);
+  msgpackpp::parser params(batch.data(), static_cast<int>(batch.size()));
+  Nvim::Grid grid;
+  NvimTest::NullRenderer renderer;
+  NvimRedraw redraw;
+
+  auto before = g_allocations.load();
+  redraw.Dispatch(&grid, &renderer, params);
+  auto warm_up = g_allocations.load() - before;
+
+  before = g_allocations.load();
+  redraw.Dispatch(&grid, &renderer, params);
+  auto replay = g_allocations.load() - before;
+
+  printf("allocations: %llu warming up, %llu replaying\n",
+         static_cast<unsigned long long>(warm_up),
+         static_cast<unsigned long long>(replay));
+  NVIM_EXPECT(warm_up > 0);
+  NVIM_EXPECT(replay == 0);
+  return 0;
+}
@@ -0,0 +1,226 @@
+#pragma once
+// A redraw batch as nvim sends it, for tests and benchmarks that have no
+// nvim to talk to. The layout follows a recorded session: a 190x45 grid
+// showing C++ source, then scrolling it a line at a time.
+#include "nvim_renderer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+namespace NvimTest {
+
+// msgpack, the subset nvim uses in redraw
+class Writer {
+  std::vector<uint8_t> _buffer;
+
+  void Byte(uint8_t b) { _buffer.push_back(b); }
+  void BigEndian(uint64_t value, int size) {
+    for (int i = size - 1; i >= 0; --i) {
+      Byte(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+public:
+  Writer &Array(uint32_t count) {
+    if (count < 16) {
+      Byte(static_cast<uint8_t>(0x90 | count));
+    } else if (count <= 0xffff) {
+      Byte(0xdc);
+      BigEndian(count, 2);
+    } else {
+      Byte(0xdd);
+      BigEndian(count, 4);
+    }
+    return *this;
+  }
+  // fixmap. keys and values follow
+  Writer &Map(uint8_t count) {
+    Byte(static_cast<uint8_t>(0x80 | count));
+    return *this;
+  }
+  Writer &Int(int64_t value) {
+    if (value >= 0 && value < 0x80) {
+      Byte(static_cast<uint8_t>(value));
+    } else if (value >= 0 && value <= 0xffff) {
+      Byte(0xcd);
+      BigEndian(static_cast<uint64_t>(value), 2);
+    } else if (value >= 0 && value <= 0xffffffff) {
+      Byte(0xce);
+      BigEndian(static_cast<uint64_t>(value), 4);
+    } else {
+      Byte(0xd3);
+      BigEndian(static_cast<uint64_t>(value), 8);
+    }
+    return *this;
+  }
+  Writer &Float(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    Byte(0xcb);
+    BigEndian(bits, 8);
+    return *this;
+  }
+  Writer &Str(std::string_view str) {
+    auto size = static_cast<uint32_t>(str.size());
+    if (size < 32) {
+      Byte(static_cast<uint8_t>(0xa0 | size));
+    } else if (size <= 0xff) {
+      Byte(0xd9);
+      BigEndian(size, 1);
+    } else {
+      Byte(0xda);
+      BigEndian(size, 2);
+    }
+    _buffer.insert(_buffer.end(), str.begin(), str.end());
+    return *this;
+  }
+  const std::vector<uint8_t> &Buffer() const { return _buffer; }
+};
+
+constexpr int ROWS = 45;
+constexpr int COLS = 190;
+
+// highlight ids of the batch. 0 is the default
+enum Highlight {
+  HL_LINE_NR = 1,
+  HL_KEYWORD,
+  HL_PUNCT,
+  HL_COMMENT,
+  HL_COUNT,
+};
+
+constexpr std::string_view SOURCE[] = {
+    "#include \"nvim_redraw.h\"",
+    "",
+    "// one [...] of an event, as soon as it is received",
+    "void NvimRedraw::DispatchArgs(Nvim::Grid *grid, NvimRenderer *renderer,",
+    "                              Nvim::RedrawEvent event,",
+    "                              const msgpackpp::parser &args) {",
+    "  (this->*HANDLERS[static_cast<size_t>(event)])(grid, renderer, args);",
+    "}",
+    "",
+    "void NvimRedraw::Flush(Nvim::Grid *grid, NvimRenderer *renderer,",
+    "                       const msgpackpp::parser &) {",
+    "  ++_stats.flushes;",
+    "  if (_backpressure) {",
+    "    ++_pending_flushes; // drawn by Render",
+    "    return;",
+    "  }",
+    "  DrawFrame(grid, renderer);",
+    "}",
+};
+
+inline bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// ["grid_line" args]: [grid, row, col_start, cells]. cells as nvim makes
+// them: the hl id only when it changes, runs of one char as a repeat
+inline void WriteGridLine(Writer &w, int row, int line) {
+  auto text = SOURCE[line % (sizeof(SOURCE) / sizeof(SOURCE[0]))];
+  char number[8];
+  auto number_size = snprintf(number, sizeof(number), "%4d ", line + 1);
+
+  struct Cell {
+    char c;
+    int hl;
+    int repeat;
+  };
+  std::vector<Cell> cells;
+  for (int i = 0; i < number_size; ++i) {
+    cells.push_back({number[i], HL_LINE_NR, 1});
+  }
+  auto comment = text.find("//");
+  for (size_t i = 0; i < text.size(); ++i) {
+    auto c = text[i];
+    int hl = 0;
+    if (i >= comment) {
+      hl = HL_COMMENT;
+    } else if (text[0] == '#') {
+      hl = HL_KEYWORD;
+    } else if (!IsWordChar(c) && c != ' ') {
+      hl = HL_PUNCT;
+    }
+    auto &last = cells.back();
+    if (c == ' ' && last.c == ' ' && last.hl == hl) {
+      ++last.repeat;
+    } else {
+      cells.push_back({c, hl, 1});
+    }
+  }
+  int used = number_size + static_cast<int>(text.size());
+  if (used < COLS) {
+    cells.push_back({' ', 0, COLS - used});
+  }
+
+  w.Array(4).Int(1).Int(row).Int(0).Array(static_cast<uint32_t>(cells.size()));
+  int hl = -1;
+  for (auto &cell : cells) {
+    auto count = cell.repeat > 1 ? 3 : cell.hl != hl ? 2 : 1;
+    w.Array(count).Str(std::string_view(&cell.c, 1));
+    if (count > 1) {
+      w.Int(cell.hl);
+    }
+    if (count > 2) {
+      w.Int(cell.repeat);
+    }
+    hl = cell.hl;
+  }
+}
+
+// params of a "redraw" notification: [event, event, ...].
+// A full screen draw, then each scroll is
+// grid_scroll, grid_line, grid_cursor_goto and flush
+inline std::vector<uint8_t> MakeRedrawBatch(int scrolls) {
+  Writer w;
+  w.Array(9 + scrolls * 4);
+
+  w.Array(2).Str("grid_resize").Array(3).Int(1).Int(COLS).Int(ROWS);
+  w.Array(2).Str("default_colors_set");
+  w.Array(5).Int(0xd4d4d4).Int(0x1e1e1e).Int(0xff0000).Int(0).Int(0);
+  w.Array(1 + HL_COUNT - 1).Str("hl_attr_define");
+  const int colors[] = {0, 0x858585, 0x569cd6, 0xd4d4d4, 0x6a9955};
+  for (int id = 1; id < HL_COUNT; ++id) {
+    w.Array(4).Int(id).Map(1).Str("foreground").Int(colors[id]).Map(0).Array(0);
+  }
+  w.Array(2).Str("mode_change").Array(2).Str("normal").Int(0);
+  w.Array(2).Str("grid_clear").Array(1).Int(1);
+  w.Array(1 + ROWS).Str("grid_line");
+  for (int row = 0; row < ROWS; ++row) {
+    WriteGridLine(w, row, row);
+  }
+  w.Array(2).Str("grid_cursor_goto").Array(3).Int(1).Int(0).Int(5);
+  w.Array(2).Str("busy_stop").Array(0);
+  w.Array(2).Str("flush").Array(0);
+
+  for (int i = 0; i < scrolls; ++i) {
+    w.Array(2).Str("grid_scroll");
+    w.Array(7).Int(1).Int(0).Int(ROWS).Int(0).Int(COLS).Int(1).Int(0);
+    w.Array(2).Str("grid_line");
+    WriteGridLine(w, ROWS - 1, ROWS + i);
+    w.Array(2).Str("grid_cursor_goto").Array(3).Int(1).Int(ROWS / 2).Int(5);
+    w.Array(2).Str("flush").Array(0);
+  }
+  return w.Buffer();
+}
+
+// draws nothing
+class NullRenderer : public NvimRenderer {
+public:
+  void SetFont(std::string_view font, float size) override {}
+  std::tuple<float, float> FontSize() const override { return {8, 16}; }
+  void DrawGridLine(const Nvim::Grid *grid, int row) override {}
+  void Composite(const Nvim::Grid *const *grids, size_t count) override {}
+  void DrawCursor(const Nvim::Grid *grid) override {}
+  void DrawBorderRectangles(const Nvim::Grid *grid, int width,
+                            int height) override {}
+  std::tuple<int, int> StartDraw() override {
+    return {static_cast<int>(COLS * 8), static_cast<int>(ROWS * 16)};
+  }
+  void FinishDraw() override {}
+};
+
+} // namespace NvimTest
@@ -0,0 +1,146 @@
+// NvimRpc coalesces outgoing messages. Everything queued inside a Batch, or
+// before the io thread gets to it, goes out in one write.
+// see NvimStreamTransport::write_async
+#include "nvim_io_pool.h"
+#include "nvim_pipe.h"
+#include "nvim_rpc.h"
+#include "nvim_test.h"
+#include <algorithm>
+#include <asio.hpp>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+constexpr int MESSAGE_COUNT = 1000;
+
+// a connected pair. ours is for the transport, peer is read by the test
+static bool MakePair(native_pipe_t *ours, native_pipe_t *peer) {
+#ifdef _WIN32
+  auto name = std::string("\\\\.\\pipe\\nvim_texture_test.") +
+              std::to_string(GetCurrentProcessId());
+  *ours = CreateNamedPipeA(
+      name.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+      PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 64 * 1024,
+      64 * 1024, 0, nullptr);
+  if (*ours == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  *peer = CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  return *peer != INVALID_HANDLE_VALUE;
+#else
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    return false;
+  }
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  *ours = fds[0];
+  *peer = fds[1];
+  return true;
+#endif
+}
+
+// everything received until the transport closes its end
+static void Drain(native_pipe_t peer, std::vector<uint8_t> *received) {
+  uint8_t buf[4096];
+  while (true) {
+#ifdef _WIN32
+    DWORD size;
+    if (!ReadFile(peer, buf, sizeof(buf), &size, nullptr) || size == 0) {
+      CloseHandle(peer);
+      return;
+    }
+#else
+    auto size = read(peer, buf, sizeof(buf));
+    if (size <= 0) {
+      close(peer);
+      return;
+    }
+#endif
+    received->insert(received->end(), buf, buf + size);
+  }
+}
+
+static void QueueInputs(NvimRpc &rpc, const std::vector<uint8_t> &msg) {
+  for (int i = 0; i < MESSAGE_COUNT; ++i) {
+    rpc.write_async(msg);
+  }
+}
+
+// taken by a flush. counted when the write starts
+static Nvim::WriteStats WaitFlushed(NvimRpc &rpc, uint64_t messages) {
+  auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (rpc.write_stats().messages < messages &&
+         std::chrono::steady_clock::now() < until) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return rpc.write_stats();
+}
+
+// Post a task that holds the only io thread until release is set. Returns
+// once it runs, so no flush or write completion can run in between.
+static void HoldIOThread(NvimIOPool &pool, std::promise<void> &release) {
+  std::promise<void> held;
+  asio::post(pool.Context(), [&held, busy = release.get_future().share()]() {
+    held.set_value();
+    busy.wait();
+  });
+  held.get_future().wait();
+}
+
+int main() {
+  // one io thread, so the test can hold it
+  NvimIOPool pool(1);
+  native_pipe_t ours;
+  native_pipe_t peer;
+  NVIM_EXPECT(MakePair(&ours, &peer));
+  std::vector<uint8_t> received;
+  std::thread drain([peer, &received]() { Drain(peer, &received); });
+
+  auto msg = msgpackpp::make_rpc_notify("nvim_input", "j");
+  {
+    NvimRpc rpc;
+    rpc.attach(NvimTransport(pool.Context(), ours));
+
+    // corked: one write however fast the io thread is
+    {
+      NvimRpc::Batch batch(rpc);
+      QueueInputs(rpc, msg);
+    }
+    auto stats = WaitFlushed(rpc, MESSAGE_COUNT);
+    NVIM_EXPECT(stats.messages == MESSAGE_COUNT);
+    NVIM_EXPECT(stats.writes == 1);
+
+    // not corked: messages queued while the io thread is busy share a write.
+    // the first write may still be in flight. its completion then takes
+    // them, instead of a newly posted flush
+    std::promise<void> release;
+    HoldIOThread(pool, release);
+    QueueInputs(rpc, msg);
+    release.set_value();
+    stats = WaitFlushed(rpc, MESSAGE_COUNT * 2);
+    NVIM_EXPECT(stats.messages == MESSAGE_COUNT * 2);
+    NVIM_EXPECT(stats.writes == 2);
+    NVIM_EXPECT(stats.bytes == MESSAGE_COUNT * 2 * msg.size());
+
+    printf("%d notifications: %llu writes, %llu bytes\n", MESSAGE_COUNT * 2,
+           static_cast<unsigned long long>(stats.writes),
+           static_cast<unsigned long long>(stats.bytes));
+  }
+
+  // ~NvimRpc closed ours
+  drain.join();
+  NVIM_EXPECT(received.size() == MESSAGE_COUNT * 2 * msg.size());
+  for (size_t pos = 0; pos < received.size(); pos += msg.size()) {
+    NVIM_EXPECT(std::equal(msg.begin(), msg.end(), received.begin() + pos));
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Print a dump of the trace ring as text, one record per line:
+//   sequence  milliseconds since the first record  event  args...
+// see NvimFrontend::DumpTrace
+//   nvim_trace_format trace.bin
+#include "nvim_trace.h"
+#include <stdint.h>
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+    return 1;
+  }
+  auto fp = fopen(argv[1], "rb");
+  if (!fp) {
+    fprintf(stderr, "can not open %s\n", argv[1]);
+    return 1;
+  }
+
+  // as TraceRing::Dump writes them. field by field, no padding
+  uint64_t sequence;
+  int64_t time_ns;
+  uint16_t event;
+  int32_t args[4];
+  int64_t start_ns = 0;
+  size_t count = 0;
+  while (fread(&sequence, sizeof(sequence), 1, fp) == 1 &&
+         fread(&time_ns, sizeof(time_ns), 1, fp) == 1 &&
+         fread(&event, sizeof(event), 1, fp) == 1 &&
+         fread(args, sizeof(args), 1, fp) == 1) {
+    if (!count) {
+      start_ns = time_ns;
+    }
+    auto e = static_cast<Nvim::TraceEvent>(event);
+    printf("%8llu %12.3f %-12s", static_cast<unsigned long long>(sequence),
+           (time_ns - start_ns) / 1e6, Nvim::TraceEventName(e));
+    for (int i = 0; i < Nvim::TraceEventArgCount(e); ++i) {
+      printf(" %d", args[i]);
+    }
+    printf("\n");
+    ++count;
+  }
+  fclose(fp);
+  fprintf(stderr, "%zu records\n", count);
+  return 0;
+}